@@ -201,6 +201,40 @@ enum BytecodeFormat {
   BYTECODE(INTRINSIC_ARRAY_DO,         1, OP, "intrinsic array do")            \
   BYTECODE(INTRINSIC_HASH_FIND,        1, OP, "intrinsic hash find")           \
   BYTECODE(INTRINSIC_HASH_DO,          1, OP, "intrinsic hash do")             \
+  \
+  SUPERINSTRUCTIONS(SUPERINSTRUCTION_BYTECODE, BYTECODE)
+
+// Superinstructions fuse two bytecodes that often follow each other, so the
+// pair only needs one dispatch.  A superinstruction replaces the opcode of
+// its first bytecode and has its length and format.  It executes the first
+// bytecode and then continues directly with the second one, whose bytes are
+// left unchanged after it.  As a consequence bcis, branch targets and inline
+// caches are unaffected, and jumping to the second bytecode still works.
+// The second bytecode can itself be a superinstruction.
+//
+// The emitter fuses bytecodes once a method is complete, except in field
+// accessors whose bytecodes are inspected by INVOKE_VIRTUAL_GET and
+// INVOKE_VIRTUAL_SET.  The interpreter generates the handlers from this list,
+// so the first bytecode of a pair must have a BODY_ macro in
+// interpreter_run.cc.  Run the VM with the bytecode_sequences debug flag on a
+// representative workload to find new candidates; it prints them in the
+// format below.
+#define SUPERINSTRUCTIONS(S, X)                                                                           \
+  S(X, LOAD_FIELD_LOCAL, INVOKE_VIRTUAL_GET,     2, OP_BU, "load field local, invoke virtual get")        \
+  S(X, LOAD_LOCAL_0,     INVOKE_VIRTUAL_GET,     1, OP,    "load local 0, invoke virtual get")            \
+  S(X, LOAD_LOCAL_1,     INVOKE_VIRTUAL_GET,     1, OP,    "load local 1, invoke virtual get")            \
+  S(X, LOAD_LOCAL_0,     INVOKE_LT,              1, OP,    "load local 0, invoke lt")                     \
+  S(X, LOAD_LOCAL_1,     INVOKE_LT,              1, OP,    "load local 1, invoke lt")                     \
+  S(X, LOAD_SMI_1,       INVOKE_ADD,             1, OP,    "load smi 1, invoke add")                      \
+  S(X, LOAD_SMI_1,       INVOKE_SUB,             1, OP,    "load smi 1, invoke sub")                      \
+  S(X, LOAD_LOCAL_0,     LOAD_SMI_1__INVOKE_ADD, 1, OP,    "load local 0, load smi 1, invoke add")        \
+  S(X, LOAD_LOCAL_1,     LOAD_SMI_1__INVOKE_ADD, 1, OP,    "load local 1, load smi 1, invoke add")        \
+  S(X, LOAD_LOCAL_2,     LOAD_SMI_1__INVOKE_ADD, 1, OP,    "load local 2, load smi 1, invoke add")        \
+  S(X, STORE_LOCAL_POP,  BRANCH_BACK,            2, OP_BS, "store local, pop, branch back")               \
+  S(X, POP_1,            BRANCH_BACK,            1, OP,    "pop 1, branch back")                          \
+
+#define SUPERINSTRUCTION_BYTECODE(BYTECODE, first, second, length, format, print) \
+  BYTECODE(first##__##second, length, format, print)
 
 #define BYTECODE_ENUM(name, length, format, print) name,
 enum Opcode { BYTECODES(BYTECODE_ENUM) ILLEGAL_END };
@@ -210,4 +244,9 @@ enum Opcode { BYTECODES(BYTECODE_ENUM) ILLEGAL_END };
 BYTECODES(BYTECODE_ENUM)
 #undef BYTECODE_ENUM
 
+// The superinstructions come last, so they are easy to recognize.
+#define SUPERINSTRUCTION_COUNT(X, first, second, length, format, print) + 1
+static const int FIRST_SUPERINSTRUCTION = ILLEGAL_END - (0 SUPERINSTRUCTIONS(SUPERINSTRUCTION_COUNT, _));
+#undef SUPERINSTRUCTION_COUNT
+
 } // namespace toit
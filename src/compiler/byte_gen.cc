@@ -63,6 +63,9 @@ int ByteGen::assemble_function(ir::Method* function,
 
   visit(function);
 
+  // The interpreter looks at the bytecodes of field accessors, so they must
+  // keep their plain form.
+  if (!is_field_accessor) emitter.fuse_superinstructions();
   auto bytecodes = emitter.bytecodes();
   int max_height = emitter.max_height();
 
@@ -139,6 +142,7 @@ int ByteGen::_assemble_nested_function(Node* body,
     __ ret();
   }
 
+  nested_emitter.fuse_superinstructions();
   List<uint8> bytecodes = nested_emitter.bytecodes();
   int max_height = nested_emitter.max_height();
   int id = -1;
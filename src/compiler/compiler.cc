@@ -17,9 +17,11 @@
 
 #include <errno.h>
 #ifdef TOIT_POSIX
+#include <signal.h>
 #include <sys/param.h>
 #include <sys/wait.h>
 #endif
+#include <atomic>
 #include <string>
 #include <limits.h>
 #include <unistd.h>
@@ -52,6 +54,7 @@
 #include "util.h"
 
 #include "../objects_inline.h"
+#include "../os.h"
 #include "../snapshot.h"
 #include "../flags.h"
 #include "../utils.h"
@@ -64,6 +67,8 @@ namespace compiler {
 const int ENTRY_UNIT_INDEX = 0;
 const int CORE_UNIT_INDEX = 1;
 
+const int PARSER_THREAD_STACK_SIZE = 8 * MB;
+
 struct PipelineConfiguration {
   char** snapshot_args;
 
@@ -121,7 +126,11 @@ class Pipeline {
 
  protected:
   virtual Source* _load_file(const char* path, const PackageLock& package_lock);
-  virtual ast::Unit* parse(Source* source);
+  /// Parses the given source.
+  ///
+  /// Sources are parsed concurrently, so implementations must report to the
+  ///   given [diagnostics] and not to the pipeline's diagnostics.
+  virtual ast::Unit* parse(Source* source, Diagnostics* diagnostics);
   virtual void do_with_lsp_selection_handler(const std::function<void (LspSelectionHandler*)>& callback);
 
   // Gives the Pipeline the opportunity to change the program once it was
@@ -153,7 +162,8 @@ class Pipeline {
   SymbolCanonicalizer _symbols;
   ToitdocRegistry _toitdoc_registry;
 
-  ast::Unit* _parse_source(Source* source);
+  ast::Unit* _parse_source(Source* source, Diagnostics* diagnostics);
+  std::vector<ast::Unit*> _parse_sources(const std::vector<Source*>& sources);
 
   void _report_failed_import(ast::Import* import,
                              ast::Unit* unit,
@@ -217,7 +227,7 @@ class LocationLanguageServerPipeline : public LanguageServerPipeline {
   }
 
  protected:
-  ast::Unit* parse(Source* source);
+  ast::Unit* parse(Source* source, Diagnostics* diagnostics);
 
   /// Whether the scanner should make keywords to identifiers if they are
   /// at the LSP-selection point.
@@ -453,7 +463,7 @@ void Compiler::lsp_snapshot(const char* source_path,
   printf("OK\n%d\n", bundle.size());
   int written = fwrite(bundle.buffer(), 1, bundle.size(), stdout);
   fflush(stdout);
-  free(bundle.buffer());
+  bundle.release();
   if (written != bundle.size()) {
     FATAL("Couldn't write snapshot");
   }
@@ -607,6 +617,37 @@ static void wait_for_child(int cpid, Diagnostics* diagnostics) {
   }
 }
 
+// Runs a pipeline of the given type in a forked child process that sends the
+// result back through a pipe.  Returns the pid of the child and stores the
+// read end of the pipe in [read_fd].
+template<typename P>
+static pid_t fork_pipeline(const PipelineConfiguration& configuration,
+                           List<const char*> source_paths,
+                           int* read_fd) {
+  int pipefd[2];
+  if (pipe(pipefd) == -1) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  pid_t cpid = fork();
+  if (cpid == -1) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (cpid == 0) {
+    // The child.
+    close(pipefd[0]);
+    P pipeline(configuration);
+    auto pipeline_result = pipeline.run(source_paths);
+    send_pipeline_result(pipefd[1], pipeline_result);
+    close(pipefd[1]);
+    exit(0);
+  }
+  close(pipefd[1]);  // Not needing that direction.
+  *read_fd = pipefd[0];
+  return cpid;
+}
+
 #endif
 
 static const uint8* wrap_direct_script_expression(const char* direct_script, Diagnostics* diagnostics);
@@ -683,37 +724,28 @@ SnapshotBundle Compiler::compile(const char* source_path,
     }
   } else {
 #ifdef TOIT_POSIX
-    int pipefd[2];
-    if (pipe(pipefd) == -1) {
-      perror("pipe");
-      exit(EXIT_FAILURE);
-    }
-    int read_fd = pipefd[0];
-    int write_fd = pipefd[1];
-
-    pid_t cpid = fork();
-    if (cpid == 0) {
-      // The child.
-      close(read_fd);
-
-      Pipeline pipeline(main_configuration);
-      auto pipeline_result = pipeline.run(source_paths);
-      send_pipeline_result(write_fd, pipeline_result);
-      if (pipeline_result.is_valid()) {
-        DebugCompilationPipeline debug_pipeline(debug_configuration);
-        pipeline_result = debug_pipeline.run(source_paths);
-        send_pipeline_result(write_fd, pipeline_result);
-      }
-      close(write_fd);
-      exit(0);
-    }
-    close(write_fd);  // Not needing that direction.
-    pipeline_main_result = receive_pipeline_result(read_fd);
+    // Run the main and the debug compilation in parallel, each in its own
+    // child process.  They only share the (read-only) sources.
+    int main_read_fd;
+    int debug_read_fd;
+    pid_t main_cpid = fork_pipeline<Pipeline>(main_configuration, source_paths, &main_read_fd);
+    pid_t debug_cpid = fork_pipeline<DebugCompilationPipeline>(debug_configuration, source_paths, &debug_read_fd);
+
+    pipeline_main_result = receive_pipeline_result(main_read_fd);
+    close(main_read_fd);
+    wait_for_child(main_cpid, main_configuration.diagnostics);
     if (pipeline_main_result.is_valid()) {
-      pipeline_debug_result = receive_pipeline_result(read_fd);
+      pipeline_debug_result = receive_pipeline_result(debug_read_fd);
+      close(debug_read_fd);
+      wait_for_child(debug_cpid, main_configuration.diagnostics);
+    } else {
+      // The debug compilation is useless without the main one, so we don't
+      // wait for it to finish.
+      close(debug_read_fd);
+      kill(debug_cpid, SIGKILL);
+      int status;
+      while (waitpid(debug_cpid, &status, 0) == -1 && errno == EINTR) {}
     }
-    close(read_fd);
-    wait_for_child(cpid, main_configuration.diagnostics);
 #else
     FATAL("fork not supported");
 #endif
@@ -783,9 +815,9 @@ static int compute_source_offset(const uint8* source, int line_number, int utf16
   return offset;
 }
 
-ast::Unit* Pipeline::parse(Source* source) {
-  Scanner scanner(source, symbol_canonicalizer(), diagnostics());
-  Parser parser(source, &scanner, diagnostics());
+ast::Unit* Pipeline::parse(Source* source, Diagnostics* diagnostics) {
+  Scanner scanner(source, symbol_canonicalizer(), diagnostics);
+  Parser parser(source, &scanner, diagnostics);
   return parser.parse_unit();
 }
 
@@ -931,8 +963,8 @@ PackageLock DebugCompilationPipeline::load_package_lock(const List<const char*>
                            diagnostics());
 }
 
-ast::Unit* LocationLanguageServerPipeline::parse(Source* source) {
-  if (strcmp(source->absolute_path(), _lsp_selection_path) != 0) return Pipeline::parse(source);
+ast::Unit* LocationLanguageServerPipeline::parse(Source* source, Diagnostics* diagnostics) {
+  if (strcmp(source->absolute_path(), _lsp_selection_path) != 0) return Pipeline::parse(source, diagnostics);
 
   const uint8* text = source->text();
   int offset = compute_source_offset(text, _line_number, _column_number);
@@ -948,8 +980,8 @@ ast::Unit* LocationLanguageServerPipeline::parse(Source* source) {
   }
 
   LspSource lsp_source(source, offset);
-  Scanner scanner(&lsp_source, is_lsp_selection_identifier(), symbol_canonicalizer(), diagnostics());
-  Parser parser(&lsp_source, &scanner, diagnostics());
+  Scanner scanner(&lsp_source, is_lsp_selection_identifier(), symbol_canonicalizer(), diagnostics);
+  Parser parser(&lsp_source, &scanner, diagnostics);
   // The source of the unit is not the source we are giving to the scanner and parser.
   return parser.parse_unit(source);
 }
@@ -1021,9 +1053,70 @@ void GotoDefinitionPipeline::lsp_selection_import_path(const char* path,
 ///
 /// If `path == ""` assumes that an error has already been reported, and just
 ///   returns the error unit.
-ast::Unit* Pipeline::_parse_source(Source* source) {
+ast::Unit* Pipeline::_parse_source(Source* source, Diagnostics* diagnostics) {
   if (Flags::trace) printf("Parsing file '%s'\n", source->absolute_path());
-  return parse(source);
+  return parse(source, diagnostics);
+}
+
+class ParserThread : public Thread {
+ public:
+  explicit ParserThread(const std::function<void ()>& work)
+      : Thread("Parser"), _work(work) { }
+
+ protected:
+  void entry() { _work(); }
+
+ private:
+  std::function<void ()> _work;
+};
+
+/// Parses the given sources, using multiple threads if there is more than one.
+///
+/// The diagnostics of each source are buffered and reported in the order of
+///   the sources, so the output is the same as when parsing sequentially.
+std::vector<ast::Unit*> Pipeline::_parse_sources(const std::vector<Source*>& sources) {
+  int count = sources.size();
+  std::vector<ast::Unit*> result(count);
+  int thread_count = Flags::compiler_threads;
+  if (thread_count <= 0) thread_count = OS::num_cores();
+  if (thread_count > count) thread_count = count;
+  if (thread_count <= 1) {
+    for (int i = 0; i < count; i++) {
+      result[i] = _parse_source(sources[i], diagnostics());
+    }
+    return result;
+  }
+
+  std::vector<BufferedDiagnostics> buffers;
+  buffers.reserve(count);
+  for (int i = 0; i < count; i++) {
+    buffers.emplace_back(diagnostics());
+  }
+  std::atomic<int> next_index(0);
+  auto work = [&]() {
+    while (true) {
+      int index = next_index++;
+      if (index >= count) return;
+      result[index] = _parse_source(sources[index], &buffers[index]);
+    }
+  };
+  // The current thread is one of the workers.
+  std::vector<ParserThread*> threads;
+  for (int i = 1; i < thread_count; i++) {
+    auto thread = _new ParserThread(work);
+    // The parser is recursive, so give it the same stack as the main thread.
+    thread->spawn(PARSER_THREAD_STACK_SIZE);
+    threads.push_back(thread);
+  }
+  work();
+  for (auto thread : threads) {
+    thread->join();
+    delete thread;
+  }
+  for (auto& buffer : buffers) {
+    buffer.replay();
+  }
+  return result;
 }
 
 static const uint8* wrap_direct_script_expression(const char* direct_script, Diagnostics* diagnostics) {
@@ -1360,9 +1453,8 @@ std::vector<ast::Unit*> Pipeline::_parse_units(List<const char*> source_paths,
 
   std::vector<ast::Unit*> units;
 
-  UnorderedMap<Source*, ast::Unit*> parsed_units;
-
-  std::vector<std::string> canonicalized_source_paths;
+  // Maps each source to the index of its unit in [units].
+  UnorderedMap<Source*, int> unit_indexes;
 
   // Add the entry file first.
   // We are only allowed to add one source file here (even if there are
@@ -1371,12 +1463,12 @@ std::vector<ast::Unit*> Pipeline::_parse_units(List<const char*> source_paths,
   // If there is more than one source_path, they are added after the core
   //   library.
   ASSERT(!source_paths.is_empty());
+  std::vector<Source*> initial_sources;
   auto entry_path = source_paths[0];
   auto entry_source = _load_file(entry_path, package_lock);
-  auto entry_unit = _parse_source(entry_source);
-  parsed_units[entry_source] = entry_unit;
-  ASSERT(units.size() == ENTRY_UNIT_INDEX);
-  units.push_back(entry_unit);
+  ASSERT(initial_sources.size() == ENTRY_UNIT_INDEX);
+  initial_sources.push_back(entry_source);
+  unit_indexes[entry_source] = ENTRY_UNIT_INDEX;
 
   // Add the core library which is implicitly imported.
   {
@@ -1386,55 +1478,85 @@ std::vector<ast::Unit*> Pipeline::_parse_units(List<const char*> source_paths,
     auto source = _load_file(builder.c_str(), package_lock);
     // If the entry is the same as the core lib we will parse the core library
     // twice. That shouldn't be a problem.
-    auto unit = _parse_source(source);
-    parsed_units[unit->source()] = unit;
-    ASSERT(units.size() == CORE_UNIT_INDEX);
-    units.push_back(unit);
+    ASSERT(initial_sources.size() == CORE_UNIT_INDEX);
+    initial_sources.push_back(source);
+    unit_indexes[source] = CORE_UNIT_INDEX;
   }
 
   // All source paths except for the entry-path come after the core unit.
   for (int i = 1; i < source_paths.length(); i++) {
     auto path = source_paths[i];
     auto source = _load_file(path, package_lock);
-    if (parsed_units.lookup(source) != null) {
+    if (unit_indexes.find(source) != unit_indexes.end()) {
       // The same filename was given multiple times.
       continue;
     }
-    auto unit = _parse_source(source);
-    parsed_units[source] = unit;
-    units.push_back(unit);
+    unit_indexes[source] = initial_sources.size();
+    initial_sources.push_back(source);
   }
 
-  // Transitively parse the source_files.
-  // Note that we modify the vector inside the loop, growing it.
-  for (size_t i = 0; i < units.size(); i++) {
-    auto unit = units[i];
-    auto imports = unit->imports();
-    for (auto import : imports) {
-      if (import->unit() != null) continue;
-      auto import_source = _load_import(unit, import, package_lock);
-
-      if (import_source == null) {
-        ASSERT(diagnostics()->encountered_error());
-        bool is_error_unit = true;
-        auto error_unit = _new ast::Unit(is_error_unit);
-        import->set_unit(error_unit);
-        units.push_back(error_unit);
-        continue;
-      }
+  units = _parse_sources(initial_sources);
+
+  // Transitively parse the imports, one generation at a time. The imports of
+  //   all units of a generation are loaded first, and the newly discovered
+  //   sources are then parsed together.
+  // Units are added in the order in which they are discovered, which is the
+  //   same order as if every import was parsed as soon as it was seen.
+  size_t generation_start = 0;
+  while (generation_start < units.size()) {
+    size_t generation_end = units.size();
+    std::vector<Source*> new_sources;
+    // Imports that refer to one of the new sources, together with the index
+    //   of the unit they will point to.
+    std::vector<std::pair<ast::Import*, int>> pending_imports;
+    for (size_t i = generation_start; i < generation_end; i++) {
+      auto unit = units[i];
+      auto imports = unit->imports();
+      for (auto import : imports) {
+        if (import->unit() != null) continue;
+        auto import_source = _load_import(unit, import, package_lock);
+
+        if (import_source == null) {
+          ASSERT(diagnostics()->encountered_error());
+          bool is_error_unit = true;
+          auto error_unit = _new ast::Unit(is_error_unit);
+          import->set_unit(error_unit);
+          units.push_back(error_unit);
+          continue;
+        }
 
-      auto parsed_unit = parsed_units.lookup(import_source);
-      if (parsed_unit != null) {
-        // Already parsed.
-        import->set_unit(parsed_unit);
-        continue;
+        auto probe = unit_indexes.find(import_source);
+        if (probe != unit_indexes.end()) {
+          int index = probe->second;
+          if (units[index] != null) {
+            // Already parsed.
+            import->set_unit(units[index]);
+          } else {
+            pending_imports.push_back(std::make_pair(import, index));
+          }
+          continue;
+        }
+
+        int index = units.size();
+        unit_indexes[import_source] = index;
+        // Reserve the slot. The unit is filled in once it has been parsed.
+        units.push_back(null);
+        new_sources.push_back(import_source);
+        pending_imports.push_back(std::make_pair(import, index));
       }
+    }
 
-      auto import_unit = _parse_source(import_source);
-      import->set_unit(import_unit);
-      units.push_back(import_unit);
-      parsed_units[import_source] = import_unit;
+    auto new_units = _parse_sources(new_sources);
+    size_t new_index = 0;
+    for (size_t i = generation_end; i < units.size(); i++) {
+      if (units[i] != null) continue;  // An error unit.
+      units[i] = new_units[new_index++];
+    }
+    ASSERT(new_index == new_units.size());
+    for (auto pending : pending_imports) {
+      pending.first->set_unit(units[pending.second]);
     }
+    generation_start = generation_end;
   }
 
   return units;
@@ -301,5 +301,86 @@ void LanguageServerAnalysisDiagnostics::end_group() {
   printf("END GROUP\n");
 }
 
+static std::string format_message(const char* format, va_list& arguments) {
+  va_list copy;
+  va_copy(copy, arguments);
+  int length = vsnprintf(null, 0, format, copy);
+  va_end(copy);
+  char* buffer = unvoid_cast<char*>(malloc(length + 1));
+  vsnprintf(buffer, length + 1, format, arguments);
+  std::string result(buffer);
+  free(buffer);
+  return result;
+}
+
+void BufferedDiagnostics::emit(Severity severity, const char* format, va_list& arguments) {
+  _entries.push_back({
+    .kind = Entry::Kind::diagnostic,
+    .severity = severity,
+    .range = Source::Range::invalid(),
+    .message = format_message(format, arguments),
+  });
+}
+
+void BufferedDiagnostics::emit(Severity severity,
+                               Source::Range range,
+                               const char* format,
+                               va_list& arguments) {
+  _entries.push_back({
+    .kind = Entry::Kind::diagnostic,
+    .severity = severity,
+    .range = range,
+    .message = format_message(format, arguments),
+  });
+}
+
+void BufferedDiagnostics::start_group() {
+  _entries.push_back({
+    .kind = Entry::Kind::start_group,
+    .severity = Severity::note,
+    .range = Source::Range::invalid(),
+    .message = std::string(),
+  });
+}
+
+void BufferedDiagnostics::end_group() {
+  _entries.push_back({
+    .kind = Entry::Kind::end_group,
+    .severity = Severity::note,
+    .range = Source::Range::invalid(),
+    .message = std::string(),
+  });
+}
+
+void BufferedDiagnostics::replay() {
+  for (auto& entry : _entries) {
+    if (entry.kind == Entry::Kind::start_group) {
+      _target->start_group();
+      continue;
+    }
+    if (entry.kind == Entry::Kind::end_group) {
+      _target->end_group();
+      continue;
+    }
+    const char* message = entry.message.c_str();
+    bool has_range = entry.range.is_valid();
+    switch (entry.severity) {
+      case Severity::error:
+        if (has_range) _target->report_error(entry.range, "%s", message);
+        else _target->report_error("%s", message);
+        break;
+      case Severity::warning:
+        if (has_range) _target->report_warning(entry.range, "%s", message);
+        else _target->report_warning("%s", message);
+        break;
+      case Severity::note:
+        if (has_range) _target->report_note(entry.range, "%s", message);
+        else _target->report_note("%s", message);
+        break;
+    }
+  }
+  _entries.clear();
+}
+
 } // namespace toit::compiler
 } // namespace toit
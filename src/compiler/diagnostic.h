@@ -16,6 +16,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "../top.h"
 
@@ -176,5 +177,46 @@ class NullDiagnostics : public Diagnostics {
   void emit(Severity severity, Source::Range range, const char* format, va_list& arguments) { }
 };
 
+/// Records diagnostics so they can be reported to another diagnostics
+/// object later.
+///
+/// Sources are parsed concurrently, but their diagnostics are replayed in a
+/// fixed order, so that the output doesn't depend on thread scheduling.
+class BufferedDiagnostics : public Diagnostics {
+ public:
+  explicit BufferedDiagnostics(Diagnostics* target)
+      : Diagnostics(target->source_manager()), _target(target) {}
+
+  bool should_report_missing_main() const { return _target->should_report_missing_main(); }
+
+  void start_group();
+  void end_group();
+
+  /// Reports all recorded diagnostics to the target, in the order they
+  /// were recorded, and clears them.
+  void replay();
+
+ protected:
+  void emit(Severity severity, const char* format, va_list& arguments);
+  void emit(Severity severity, Source::Range range, const char* format, va_list& arguments);
+
+ private:
+  struct Entry {
+    enum class Kind {
+      diagnostic,
+      start_group,
+      end_group,
+    };
+
+    Kind kind;
+    Severity severity;
+    Source::Range range;
+    std::string message;
+  };
+
+  Diagnostics* _target;
+  std::vector<Entry> _entries;
+};
+
 } // namespace toit::compiler
 } // namespace toit
@@ -62,6 +62,29 @@ List<uint8> Emitter::bytecodes() {
   return _builder.build();
 }
 
+static Opcode superinstruction(Opcode first, Opcode second) {
+#define FUSE(X, first_opcode, second_opcode, length, format, print)          \
+  if (first == first_opcode && second == second_opcode) {                    \
+    return first_opcode##__##second_opcode;                                  \
+  }
+  SUPERINSTRUCTIONS(FUSE, _)
+#undef FUSE
+  return ILLEGAL_END;
+}
+
+void Emitter::fuse_superinstructions() {
+  // Only the opcode of the first bytecode is replaced, so positions and
+  // labels stay valid.  Going backwards lets a superinstruction absorb a
+  // following one.
+  for (int i = _opcode_positions.length() - 2; i >= 0; i--) {
+    unsigned position = _opcode_positions[i];
+    Opcode first = static_cast<Opcode>(_builder[position]);
+    Opcode second = static_cast<Opcode>(_builder[_opcode_positions[i + 1]]);
+    Opcode fused = superinstruction(first, second);
+    if (fused != ILLEGAL_END) _builder[position] = fused;
+  }
+}
+
 inline void Emitter::emit_possibly_wide(Opcode op, word value) {
   if (value <= MAX_BYTECODE_VALUE) {
     emit(op, value);
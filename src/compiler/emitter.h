@@ -78,6 +78,11 @@ class Emitter {
 
   List<uint8> bytecodes();
 
+  // Replaces frequent pairs of bytecodes with the superinstructions from
+  // bytecodes.h.  Must be the last step before getting the bytecodes, as
+  // the other peephole optimizations don't know about superinstructions.
+  void fuse_superinstructions();
+
   unsigned position() const { return _builder.length(); }
 
   int arity() const { return _arity; }
@@ -38,7 +38,9 @@ ENTRY_POINTS(E)
 };
 
 SymbolCanonicalizer::SymbolCanonicalizer()
-      : _identifier_trie(0), _number_trie(0) {
+      : _identifier_trie(0)
+      , _number_trie(0)
+      , _mutex(OS::allocate_mutex(5, "SymbolCanonicalizer")) {
   for (unsigned i = 0; i < ARRAY_SIZE(keywords); i++) {
     Token::Kind kind = keywords[i];
     const uint8* syntax = unsigned_cast(Token::symbol(kind).c_str());
@@ -57,7 +59,12 @@ SymbolCanonicalizer::SymbolCanonicalizer()
   }
 }
 
+SymbolCanonicalizer::~SymbolCanonicalizer() {
+  OS::dispose(_mutex);
+}
+
 SymbolCanonicalizer::TokenSymbol SymbolCanonicalizer::canonicalize_identifier(const uint8* from, const uint8* to) {
+  Locker locker(_mutex);
   Trie* trie = _identifier_trie.get(from, to);
   if (trie->kind == 0) {
     trie->kind = Token::IDENTIFIER;
@@ -70,6 +77,7 @@ SymbolCanonicalizer::TokenSymbol SymbolCanonicalizer::canonicalize_identifier(co
 }
 
 Symbol SymbolCanonicalizer::canonicalize_number(const uint8* from, const uint8* to) {
+  Locker locker(_mutex);
   Trie* trie = _number_trie.get(from, to);
   if (trie->kind == 0) {
     // We are arbitrarily using 'integer' as token here.
@@ -17,6 +17,7 @@
 
 #include "token.h"
 #include "trie.h"
+#include "../os.h"
 
 namespace toit {
 namespace compiler {
@@ -29,6 +30,10 @@ class SymbolCanonicalizer {
   };
 
   SymbolCanonicalizer();
+  ~SymbolCanonicalizer();
+
+  // The canonicalizer is thread-safe, so that sources can be scanned in
+  // parallel.
 
   // Returns a TokenSymbol.
   //
@@ -45,6 +50,9 @@ class SymbolCanonicalizer {
 
   // Copy of canonicalized syntax for identifiers and numbers.
   ListBuilder<const uint8*> _syntax;
+
+  // Protects the tries.
+  Mutex* _mutex;
 };
 
 } // namespace toit::compiler
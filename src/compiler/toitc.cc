@@ -110,7 +110,7 @@ int main(int argc, char **argv) {
     auto bundle = SnapshotBundle::read_from_file(bundle_filename);
     if (!bundle.is_valid()) print_usage(1);
     write_image_from_bundle(image_filename, bundle);
-    free(bundle.buffer());
+    bundle.release();
   } else {
     char* bundle_filename = null;
 
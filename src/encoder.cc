@@ -252,6 +252,16 @@ bool ProgramOrientedEncoder::encode_error(Object* type, Object* message, Stack*
   return !buffer()->has_overflow();
 }
 
+bool ProgramOrientedEncoder::encode_sampled_profile(SamplingProfiler* profiler, String* title) {
+  profiler->encode_on(this, title);
+  return !buffer()->has_overflow();
+}
+
+bool ProgramOrientedEncoder::encode_allocation_profile(AllocationProfiler* profiler, String* title) {
+  profiler->encode_on(this, title);
+  return !buffer()->has_overflow();
+}
+
 #ifdef PROFILER
 bool ProgramOrientedEncoder::encode_profile(Profiler* profiler, String* title, int cutoff) {
   profiler->encode_on(this, title, cutoff);
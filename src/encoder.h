@@ -118,6 +118,9 @@ class ProgramOrientedEncoder : public Encoder {
 
   bool encode_error(Object* type, Object* message, Stack* stack);
 
+  bool encode_sampled_profile(SamplingProfiler* profiler, String* title);
+  bool encode_allocation_profile(AllocationProfiler* profiler, String* title);
+
 #ifdef PROFILER
   bool encode_profile(Profiler* profile, String* title, int cutoff);
 #endif
@@ -19,6 +19,9 @@
 
 #include <errno.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
 
 #include "../objects_inline.h"
 
@@ -26,80 +29,233 @@
 
 namespace toit {
 
+class DNSResolverThread : public Thread {
+ public:
+  explicit DNSResolverThread(DNSEventSource* event_source)
+      : Thread("DNS")
+      , _event_source(event_source) {}
+
+ protected:
+  void entry() override {
+    _event_source->run_lookups();
+  }
+
+ private:
+  DNSEventSource* _event_source;
+};
+
+bool DNSCacheEntry::copy_to(DNSLookupRequest* request) {
+  uint8* addresses = null;
+  if (_length > 0) {
+    addresses = unvoid_cast<uint8*>(malloc(_length));
+    if (addresses == null) return false;
+    memcpy(addresses, _addresses, _length);
+  }
+  request->set_addresses(addresses, _length);
+  request->set_error(_error, _system_error);
+  return true;
+}
+
 DNSEventSource* DNSEventSource::_instance = null;
 
 DNSEventSource::DNSEventSource()
     : EventSource("DNS")
-    , Thread("DNS")
-    , _stop(false)
-    , _lookup_requests_changed(OS::allocate_condition_variable(mutex())) {
+    , _lookup_requests_changed(OS::allocate_condition_variable(mutex()))
+    , _lookup_done(OS::allocate_condition_variable(mutex())) {
   ASSERT(_instance == null);
   _instance = this;
 
-  spawn();
+  for (int i = 0; i < RESOLVER_THREADS; i++) {
+    DNSResolverThread* thread = _new DNSResolverThread(this);
+    if (thread == null || !thread->spawn()) {
+      delete thread;
+      break;
+    }
+    _threads[_thread_count++] = thread;
+  }
+  if (_thread_count == 0) FATAL("Failed to start DNS resolver threads");
 }
 
 DNSEventSource::~DNSEventSource() {
   {
     Locker locker(mutex());
     _stop = true;
-    OS::signal(_lookup_requests_changed);
+    OS::signal_all(_lookup_requests_changed);
   }
 
-  join();
+  for (int i = 0; i < _thread_count; i++) {
+    _threads[i]->join();
+    delete _threads[i];
+  }
+
+  while (DNSCacheEntry* entry = _cache.remove_first()) delete entry;
 
   OS::dispose(_lookup_requests_changed);
+  OS::dispose(_lookup_done);
 
   _instance = null;
 }
 
 void DNSEventSource::on_register_resource(Locker& locker, Resource* r) {
+  auto request = static_cast<DNSLookupRequest*>(r);
+  DNSCacheEntry* entry = find_cache_entry(request->hostname(), OS::get_monotonic_time());
+  if (entry != null && entry->copy_to(request)) {
+    request->mark_done();
+    dispatch(locker, request, 0);
+    return;
+  }
+  _pending.append(request);
   OS::signal(_lookup_requests_changed);
 }
 
 void DNSEventSource::on_unregister_resource(Locker& locker, Resource* r) {
-  OS::signal(_lookup_requests_changed);
   auto request = static_cast<DNSLookupRequest*>(r);
-  if (request->address() != null) return;
-  while (!request->is_done()) {
-    OS::wait(_lookup_requests_changed);
+  _pending.remove(request);
+  // The request is deleted once we return, so we must wait for an ongoing
+  // lookup to complete.
+  while (request->is_resolving()) {
+    OS::wait(_lookup_done);
   }
 }
 
-void DNSEventSource::entry() {
+DNSCacheEntry* DNSEventSource::find_cache_entry(const char* hostname, int64 now) {
+  for (auto it = _cache.begin(); it != _cache.end();) {
+    DNSCacheEntry* entry = *it;
+    ++it;
+    if (entry->expiry_us() <= now) {
+      _cache.unlink(entry);
+      _cache_size--;
+      delete entry;
+    } else if (strcmp(entry->hostname(), hostname) == 0) {
+      // Keep the most recently used entries at the front.
+      _cache.unlink(entry);
+      _cache.prepend(entry);
+      return entry;
+    }
+  }
+  return null;
+}
+
+void DNSEventSource::add_cache_entry(DNSLookupRequest* request, int64 now) {
+  char* hostname = strdup(request->hostname());
+  uint8* addresses = null;
+  if (request->length() > 0) addresses = unvoid_cast<uint8*>(malloc(request->length()));
+  if (hostname == null || (request->length() > 0 && addresses == null)) {
+    free(hostname);
+    free(addresses);
+    return;
+  }
+  if (addresses != null) memcpy(addresses, request->addresses(), request->length());
+  int64 ttl = request->error() == 0 ? CACHE_TTL_US : NEGATIVE_CACHE_TTL_US;
+  DNSCacheEntry* entry = _new DNSCacheEntry(
+      hostname, addresses, request->length(), request->error(), request->system_error(), now + ttl);
+  if (entry == null) {
+    free(hostname);
+    free(addresses);
+    return;
+  }
+  _cache.prepend(entry);
+  if (++_cache_size > CACHE_SIZE) {
+    delete _cache.remove_last();
+    _cache_size--;
+  }
+}
+
+// Resolves the hostname to a packed list of addresses.  Must be called
+// without holding the lock.
+static void resolve(DNSLookupRequest* request) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  // Without a socket type we get each address once per type.
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo* info = null;
+  int error = getaddrinfo(request->hostname(), null, &hints, &info);
+  if (error != 0) {
+    request->set_error(error, error == EAI_SYSTEM ? errno : 0);
+    return;
+  }
+
+  int length = 0;
+  for (struct addrinfo* it = info; it != null; it = it->ai_next) {
+    if (it->ai_family == AF_INET) {
+      length += 1 + sizeof(in_addr);
+    } else if (it->ai_family == AF_INET6) {
+      length += 1 + sizeof(in6_addr);
+    }
+  }
+
+  uint8* addresses = length > 0 ? unvoid_cast<uint8*>(malloc(length)) : null;
+  if (length > 0 && addresses == null) {
+    freeaddrinfo(info);
+    request->set_error(EAI_MEMORY, 0);
+    return;
+  }
+
+  int offset = 0;
+  for (struct addrinfo* it = info; it != null; it = it->ai_next) {
+    const void* address;
+    int size;
+    if (it->ai_family == AF_INET) {
+      address = &reinterpret_cast<struct sockaddr_in*>(it->ai_addr)->sin_addr;
+      size = sizeof(in_addr);
+    } else if (it->ai_family == AF_INET6) {
+      address = &reinterpret_cast<struct sockaddr_in6*>(it->ai_addr)->sin6_addr;
+      size = sizeof(in6_addr);
+    } else {
+      continue;
+    }
+    addresses[offset] = size;
+    memcpy(addresses + offset + 1, address, size);
+    offset += 1 + size;
+  }
+  freeaddrinfo(info);
+
+  if (length == 0) {
+    request->set_error(EAI_NONAME, 0);
+  } else {
+    request->set_addresses(addresses, length);
+  }
+}
+
+void DNSEventSource::run_lookups() {
   Locker locker(mutex());
 
   while (!_stop) {
-    if (resources().is_empty() || static_cast<DNSLookupRequest*>(resources().first())->is_done()) {
+    DNSLookupRequest* request = _pending.remove_first();
+    if (request == null) {
       OS::wait(_lookup_requests_changed);
       continue;
     }
 
-    auto request = static_cast<DNSLookupRequest*>(resources().first());
-    auto address = request->address();
-    request->set_address(null);
-
-    // Leave lock while handling lookup.
-    const struct hostent* server;
+    // Leave lock while handling lookup.  Unregistering the request waits
+    // until we are done with it.
+    request->set_resolving(true);
     { Unlocker unlock(locker);
-      server = gethostbyname(char_cast(address));
+      resolve(request);
     }
-
-    free(address);
     request->mark_done();
-    OS::signal(_lookup_requests_changed);
 
-    if (server == null) {
-      ASSERT(h_errno > 0);
-      request->set_error(h_errno);
-    } else {
-      request->set_length(server->h_length);
-      uint8_t* address = unvoid_cast<uint8_t*>(malloc(server->h_length));
-      memcpy(address, server->h_addr_list[0], server->h_length);
-      request->set_address(address);
+    int64 now = OS::get_monotonic_time();
+    add_cache_entry(request, now);
+    if (resources().is_linked(request)) {
+      dispatch(locker, request, 0);
     }
+    request->set_resolving(false);
+    OS::signal_all(_lookup_done);
 
-    dispatch(locker, request, 0);
+    // Answer other lookups of the same hostname that were queued while we
+    // were resolving it.
+    DNSCacheEntry* entry = find_cache_entry(request->hostname(), now);
+    if (entry == null) continue;
+    _pending.remove_wherever([&](DNSLookupRequest* other) -> bool {
+      if (strcmp(other->hostname(), entry->hostname()) != 0) return false;
+      if (!entry->copy_to(other)) return false;
+      other->mark_done();
+      dispatch(locker, other, 0);
+      return true;
+    });
   }
 }
 
@@ -21,38 +21,96 @@
 
 namespace toit {
 
-class DNSLookupRequest : public Resource {
-  public:
-   TAG(DNSLookupRequest);
-   DNSLookupRequest(ResourceGroup* group, uint8_t* address)
-     : Resource(group)
-     , _address(address)
-     , _done(false) {}
-
-   ~DNSLookupRequest() {
-     free(_address);
-   }
+class DNSLookupRequest;
+class DNSResolverThread;
+class DNSCacheEntry;
+
+typedef LinkedFIFO<DNSLookupRequest, 1> DNSLookupRequestList;
+typedef DoubleLinkedList<DNSCacheEntry> DNSCacheList;
+
+// The addresses of a lookup are packed into a single buffer where each
+// address is a length byte followed by the 4 or 16 address bytes.
+class DNSLookupRequest : public Resource, public DNSLookupRequestList::Element {
+ public:
+  TAG(DNSLookupRequest);
+  DNSLookupRequest(ResourceGroup* group, char* hostname)
+    : Resource(group)
+    , _hostname(hostname) {}
+
+  ~DNSLookupRequest() {
+    free(_hostname);
+    free(_addresses);
+  }
+
+  const char* hostname() { return _hostname; }
 
   void mark_done() { _done = true; }
   bool is_done() { return _done; }
 
-  uint8_t* address() { return _address; }
-  void set_address(uint8_t* address) { _address = address; }
+  bool is_resolving() { return _resolving; }
+  void set_resolving(bool value) { _resolving = value; }
 
+  uint8* addresses() { return _addresses; }
   int length() { return _length; }
-  void set_length(int length) { _length = length; }
-
+  void set_addresses(uint8* addresses, int length) {
+    free(_addresses);
+    _addresses = addresses;
+    _length = length;
+  }
+
+  // Error from getaddrinfo.  EAI_SYSTEM errors are reported through errno
+  // as the system error.
   int error() { return _error; }
-  void set_error(int error) { _error = error; }
+  int system_error() { return _system_error; }
+  void set_error(int error, int system_error) {
+    _error = error;
+    _system_error = system_error;
+  }
 
  private:
-  uint8_t* _address;
+  char* _hostname;
+  uint8* _addresses = null;
   int _length = 0;
   int _error = 0;
+  int _system_error = 0;
+  bool _resolving = false;
   bool _done = false;
 };
 
-class DNSEventSource : public EventSource, public Thread {
+// A cached answer for a hostname, including failed lookups.
+class DNSCacheEntry : public DNSCacheList::Element {
+ public:
+  DNSCacheEntry(char* hostname, uint8* addresses, int length, int error, int system_error, int64 expiry_us)
+    : _hostname(hostname)
+    , _addresses(addresses)
+    , _length(length)
+    , _error(error)
+    , _system_error(system_error)
+    , _expiry_us(expiry_us) {}
+
+  ~DNSCacheEntry() {
+    free(_hostname);
+    free(_addresses);
+  }
+
+  const char* hostname() { return _hostname; }
+  int64 expiry_us() { return _expiry_us; }
+
+  // Copies the answer to the request.  Returns false if out of memory.
+  bool copy_to(DNSLookupRequest* request);
+
+ private:
+  char* _hostname;
+  uint8* _addresses;
+  int _length;
+  int _error;
+  int _system_error;
+  int64 _expiry_us;
+};
+
+// Resolves hostnames on a small pool of threads, so a slow lookup does not
+// hold up the others.  Answers are cached for a while, and so are failures.
+class DNSEventSource : public EventSource {
  public:
   static DNSEventSource* instance() { return _instance; }
 
@@ -63,12 +121,31 @@ class DNSEventSource : public EventSource, public Thread {
   void on_unregister_resource(Locker& locker, Resource* r) override;
 
  private:
-  void entry() override;
+  friend class DNSResolverThread;
+
+  // Lookups are I/O bound, so this is independent of the number of cores.
+  static const int RESOLVER_THREADS = 4;
+  static const int CACHE_SIZE = 32;
+  // getaddrinfo does not give us the TTL of the records, so we use fixed
+  // times to live.
+  static const int64 CACHE_TTL_US = 60 * 1000000LL;
+  static const int64 NEGATIVE_CACHE_TTL_US = 5 * 1000000LL;
+
+  void run_lookups();
+  DNSCacheEntry* find_cache_entry(const char* hostname, int64 now);
+  void add_cache_entry(DNSLookupRequest* request, int64 now);
 
   static DNSEventSource* _instance;
 
-  bool _stop;
+  bool _stop = false;
   ConditionVariable* _lookup_requests_changed;
+  ConditionVariable* _lookup_done;
+  DNSLookupRequestList _pending;
+  DNSCacheList _cache;
+  int _cache_size = 0;
+
+  int _thread_count = 0;
+  DNSResolverThread* _threads[RESOLVER_THREADS];
 };
 
 } // namespace toit
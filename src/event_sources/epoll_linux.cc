@@ -18,10 +18,9 @@
 #ifdef TOIT_LINUX
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/socket.h>
-#include <signal.h>
 #include <cerrno>
 
 #include "../objects_inline.h"
@@ -30,35 +29,6 @@
 
 namespace toit {
 
-enum {
-  kAdd,
-  kRemove,
-};
-
-bool write_full(int fd, uint8_t* data, int length) {
-  int offset = 0;
-  while (offset < length) {
-    int wrote = write(fd, data + offset, length - offset);
-    if (wrote < 0 && errno != EINTR) {
-      return false;
-    }
-    offset += wrote;
-  }
-  return true;
-}
-
-bool read_full(int fd, uint8_t* data, int length) {
-  int offset = 0;
-  while (offset < length) {
-    int wrote = read(fd, data + offset, length - offset);
-    if (wrote < 0 && errno != EINTR) {
-      return false;
-    }
-    offset += wrote;
-  }
-  return true;
-}
-
 EpollEventSource* EpollEventSource::_instance = null;
 
 EpollEventSource::EpollEventSource() : EventSource("Epoll")
@@ -71,122 +41,79 @@ EpollEventSource::EpollEventSource() : EventSource("Epoll")
     FATAL("failed allocating epoll file descriptor: %d", errno)
   }
 
-  int fds[2];
-  if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
-    FATAL("failed allocating pipe file descriptors: %d", errno)
+  // The control eventfd is only used to wake up the epoll thread on shutdown.
+  // Resources are added and removed directly with epoll_ctl, which is thread
+  // safe.
+  _control_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (_control_fd < 0) {
+    FATAL("failed allocating eventfd file descriptor: %d", errno)
   }
 
-  _control_read = fds[0];
-  _control_write = fds[1];
-
   epoll_event event = {0, {0}};
-  event.events = EPOLLIN | EPOLLOUT;
-  event.data.fd = _control_read;
-  if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _control_read, &event) == -1) {
-    FATAL("failed to register close fd: %d\n", errno);
+  event.events = EPOLLIN;
+  event.data.fd = _control_fd;
+  if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _control_fd, &event) == -1) {
+    FATAL("failed to register control fd: %d\n", errno);
   }
 
   spawn();
 }
 
 EpollEventSource::~EpollEventSource() {
-  close(_control_write);
+  uint64_t value = 1;
+  while (write(_control_fd, &value, sizeof(value)) < 0) {
+    if (errno != EINTR) FATAL("failed to signal epoll thread: %d", errno);
+  }
   join();
+  close(_control_fd);
   close(_epoll_fd);
 
   _instance = null;
 }
 
-
 void EpollEventSource::on_register_resource(Locker& locker, Resource* r) {
-  auto resource = static_cast<IntResource*>(r);
-  uint64_t cmd = resource->id();
-  cmd <<= 32;
-  cmd |= kAdd;
-  if (!write_full(_control_write, reinterpret_cast<uint8_t*>(&cmd), sizeof(cmd))) {
-    FATAL("failed to send 0x%llx to epoll: %d", cmd, errno);
+  int id = static_cast<IntResource*>(r)->id();
+  epoll_event event = {0, {0}};
+  event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+  event.data.fd = id;
+  if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, id, &event) == -1) {
+    FATAL("failed to add 0x%x to epoll: %d", id, errno);
   }
 }
 
 void EpollEventSource::on_unregister_resource(Locker& locker, Resource* r) {
-  auto resource = static_cast<IntResource*>(r);
-  uint64_t cmd = resource->id();
-  cmd <<= 32;
-  cmd |= kRemove;
-  if (!write_full(_control_write, reinterpret_cast<uint8_t*>(&cmd), sizeof(cmd))) {
-    FATAL("failed to send 0x%llx to epoll: %d", cmd, errno);
+  int id = static_cast<IntResource*>(r)->id();
+  if (epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, id, null) == -1) {
+    FATAL("failed to remove 0x%x from epoll: %d", id, errno);
   }
+  // Don't close STD pipes.  Events for the closed fd that were already
+  // fetched by the epoll thread are dropped when dispatching, because we hold
+  // the event source lock and the resource is no longer registered.  If the
+  // fd is reused by a new resource before then, that resource may see a
+  // spurious wakeup, which is harmless with edge triggered events.
+  if (id > 2) close(id);
 }
 
 void EpollEventSource::entry() {
+  epoll_event events[MAX_EVENTS];
   while (true) {
-    epoll_event event;
-    int ready = epoll_wait(_epoll_fd, &event, 1, -1);
-    switch (ready) {
-      case 1: {
-        if (event.data.fd == _control_read) {
-          if (event.events & EPOLLHUP) {
-            close(_control_read);
-            return;
-          }
-
-          uint64_t cmd = 0;
-          if (!read_full(_control_read, reinterpret_cast<uint8_t*>(&cmd), sizeof(cmd))) {
-            FATAL("failed to receive 0x%llx in epoll: %d", cmd, errno);
-          }
-
-          int id = cmd >> 32;
-          switch (cmd & ((1LL << 32) - 1)) {
-            case kAdd: {
-                epoll_event event = {0, {0}};
-                event.events = EPOLLIN | EPOLLOUT | EPOLLET;
-                event.data.fd = id;
-                if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, id, &event) == -1) {
-                  FATAL("failed to add 0x%lx to epoll: %d", id, errno);
-                }
-              }
-              break;
-
-            case kRemove: {
-                if (epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, id, null) == -1) {
-                  FATAL("failed to add 0x%lx to epoll: %d", id, errno);
-                }
-                // Don't close STD pipes.
-                if (id > 2) close(id);
-              }
-              break;
-          }
-
-          continue;
-        }
-
-        Locker locker(mutex());
-        Resource* r = find_resource_by_id(locker, event.data.fd);
-        if (r != null) dispatch(locker, r, event.events);
-        break;
-      }
-
-      case 0:
-        // No events (timeout), loop.
-        break;
-
-      case  -1: {
-        if (errno == EINTR) {
-          // No events (timeout), loop.
-          break;
-        }
-        // FALL THROUGH.
-      }
-
-      default:
-        FATAL("error waiting for epoll events");
-        break;
+    int ready = epoll_wait(_epoll_fd, events, MAX_EVENTS, -1);
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      FATAL("error waiting for epoll events");
+    }
+
+    // Dispatch all fetched events under a single lock acquisition.
+    Locker locker(mutex());
+    for (int i = 0; i < ready; i++) {
+      epoll_event* event = &events[i];
+      if (event->data.fd == _control_fd) return;
+      Resource* r = find_resource_by_id(locker, event->data.fd);
+      if (r != null) dispatch(locker, r, event->events);
     }
   }
 }
 
-
-
 } // namespace toit
 
 #endif // TOIT_LINUX
@@ -28,7 +28,7 @@ class EpollEventSource : public EventSource, public Thread {
   ~EpollEventSource();
 
   bool is_control_fd(int fd) const {
-    return fd == _control_read || fd == _control_write;
+    return fd == _control_fd;
   }
 
  private:
@@ -37,11 +37,13 @@ class EpollEventSource : public EventSource, public Thread {
 
   void entry() override;
 
+  // Maximum number of events fetched by a single call to epoll_wait.
+  static const int MAX_EVENTS = 128;
+
   static EpollEventSource* _instance;
 
   int _epoll_fd;
-  int _control_read;
-  int _control_write;
+  int _control_fd;
 };
 
 } // namespace toit
@@ -26,9 +26,11 @@ TimerEventSource::TimerEventSource()
     : EventSource("Timer")
     , Thread("Timer")
     , _timer_changed(OS::allocate_condition_variable(mutex()))
+    , _current_tick(OS::get_monotonic_time() / 1000)
     , _stop(false) {
   ASSERT(_instance == null);
   _instance = this;
+  memset(_occupied, 0, sizeof(_occupied));
   spawn();
 }
 
@@ -43,32 +45,36 @@ TimerEventSource::~TimerEventSource() {
 
   join();
 
-  ASSERT(_timers.is_empty());
+  for (int level = 0; level < LEVELS; level++) {
+    for (int slot = 0; slot < SLOTS; slot++) ASSERT(_wheel[level][slot].is_empty());
+  }
+  ASSERT(_overflow.is_empty());
 
   OS::dispose(_timer_changed);
 
   _instance = null;
 }
 
+int64 TimerEventSource::tick_for(int64 timeout) {
+  if (timeout <= 0) return 0;
+  return timeout / 1000 + ((timeout % 1000 == 0) ? 0 : 1);
+}
+
 void TimerEventSource::arm(Timer* timer, int64_t timeout) {
   Locker locker(mutex());
 
-  // Get current timeout, if any.
-  auto head = _timers.first();
-  int64_t old_timeout = head ? head->timeout() : timeout + 1;
+  // Get current wakeup tick, if any.
+  int64 old_tick = next_tick();
 
   // Remove in case it was already enqueued.
-  if (_timers.is_linked(timer)) {
-    _timers.unlink(timer);
-  }
+  timer->disarm();
 
   // Clear and install timer.
   timer->set_state(0);
   timer->set_timeout(timeout);
+  insert(timer);
 
-  _timers.insert_before(timer, [&timer](Timer* t) { return timer->timeout() < t->timeout(); });
-
-  if (timeout < old_timeout) {
+  if (Utils::max(tick_for(timeout), _current_tick) < old_tick) {
     // Signal if new timeout is less the the old.
     // This means we don't re-arm even if the first timer
     // was removed. This simply means we avoid waking up NOW, but instead
@@ -81,16 +87,83 @@ void TimerEventSource::arm(Timer* timer, int64_t timeout) {
 
 void TimerEventSource::on_unregister_resource(Locker& locker, Resource* r) {
   ASSERT(is_locked());
-  Timer* timer = r->as<Timer*>();
-
-  Timer* first = _timers.first();
-  if (_timers.is_linked(timer)) {
-    _timers.unlink(timer);
-    if (first == timer) {
-      // Signal if the first one changes.
-      OS::signal(_timer_changed);
+  // We don't signal the timer thread.  If it wakes up for this timer it just
+  // finds nothing to do.
+  r->as<Timer*>()->disarm();
+}
+
+void TimerEventSource::insert(Timer* timer) {
+  ASSERT(!timer->is_armed());
+  int64 tick = Utils::max(tick_for(timer->timeout()), _current_tick);
+  for (int level = 0; level < LEVELS; level++) {
+    int shift = level * SLOT_BITS;
+    // Use the lowest level where the timer is less than a full turn of the
+    // wheel away.  On all but the lowest level this means the timer is never
+    // in the slot that is currently being processed.
+    if ((tick >> shift) - (_current_tick >> shift) < SLOTS) {
+      int slot = (tick >> shift) & SLOT_MASK;
+      _wheel[level][slot].append(timer);
+      _occupied[level] |= 1ULL << slot;
+      return;
+    }
+  }
+  _overflow.append(timer);
+}
+
+void TimerEventSource::cascade(TimerList* list) {
+  TimerList timers;
+  while (Timer* timer = list->remove_first()) timers.append(timer);
+  while (Timer* timer = timers.remove_first()) insert(timer);
+}
+
+int64 TimerEventSource::next_tick() {
+  int64 result = INT64_MAX;
+  for (int level = 0; level <= LEVELS; level++) {
+    int shift = level * SLOT_BITS;
+    bool on_boundary = (_current_tick & ((1LL << shift) - 1)) == 0;
+    int64 index = _current_tick >> shift;
+    // The slot for the current index has only been processed if we are past
+    // the tick where it is processed.
+    int first = on_boundary ? 0 : 1;
+    if (level == LEVELS) {
+      // The overflow list is processed whenever the highest level wraps.
+      if (!_overflow.is_empty()) result = Utils::min(result, (index + first) << shift);
+      break;
     }
+    uint64 bits = _occupied[level];
+    if (bits == 0) continue;
+    int rotation = (index + first) & SLOT_MASK;
+    if (rotation != 0) bits = (bits >> rotation) | (bits << (SLOTS - rotation));
+    int64 distance = first + __builtin_ctzll(bits);
+    result = Utils::min(result, (index + distance) << shift);
+  }
+  return result;
+}
+
+void TimerEventSource::process_tick(Locker& locker, int64 tick) {
+  ASSERT(tick >= _current_tick);
+  _current_tick = tick;
+
+  // Cascade timers from the higher levels (and the overflow list) that have
+  // reached the lowest level.
+  if ((tick & ((1LL << (LEVELS * SLOT_BITS)) - 1)) == 0) cascade(&_overflow);
+  for (int level = LEVELS - 1; level > 0; level--) {
+    int shift = level * SLOT_BITS;
+    if ((tick & ((1LL << shift) - 1)) != 0) continue;
+    int slot = (tick >> shift) & SLOT_MASK;
+    _occupied[level] &= ~(1ULL << slot);
+    cascade(&_wheel[level][slot]);
+  }
+
+  // Dispatch all the timers that expire in this tick as one batch.
+  int slot = tick & SLOT_MASK;
+  _occupied[0] &= ~(1ULL << slot);
+  TimerList* expired = &_wheel[0][slot];
+  while (Timer* timer = expired->remove_first()) {
+    dispatch(locker, timer, 0);
   }
+
+  _current_tick = tick + 1;
 }
 
 void TimerEventSource::entry() {
@@ -98,19 +171,20 @@ void TimerEventSource::entry() {
 
   while (!_stop) {
     int64 time = OS::get_monotonic_time();
+    int64 now = time / 1000;
 
-    int64 delay_us = 0;
-    while (!_timers.is_empty()) {
-      if (time >= _timers.first()->timeout()) {
-        Timer* timer = _timers.remove_first();
-        dispatch(locker, timer, 0);
-      } else {
-        delay_us = _timers.first()->timeout() - time;
-        break;
-      }
+    int64 tick;
+    while ((tick = next_tick()) <= now) {
+      process_tick(locker, tick);
     }
+    // Nothing is due before the next tick, so we can skip ahead.
+    _current_tick = now + 1;
 
-    int delay_ms = (delay_us + 1000 - 1) / 1000;  // Ceiling division.
+    int delay_ms = 0;
+    if (tick != INT64_MAX) {
+      int64 delay_us = tick * 1000 - time;
+      delay_ms = (delay_us + 1000 - 1) / 1000;  // Ceiling division.
+    }
     OS::wait(_timer_changed, delay_ms);
   }
 }
@@ -40,6 +40,13 @@ class Timer : public Resource, public TimerList::Element {
 
   int64 timeout() const { return _timeout; }
 
+  bool is_armed() const { return !TimerList::Element::is_not_linked(); }
+
+  // Removes the timer from the timing wheel, if it is armed.
+  void disarm() {
+    if (is_armed()) TimerList::Element::unlink();
+  }
+
  private:
   int64 _timeout;
 };
@@ -58,10 +65,33 @@ class TimerEventSource : public EventSource, public Thread {
  private:
   void entry() override;
 
+  // Timers are kept in a hierarchical timing wheel with millisecond ticks.
+  // Level 0 has a slot for each of the next 64 ticks.  Each slot on a higher
+  // level covers all the slots of the level below, and its timers are
+  // cascaded into the lower levels when the wheel reaches it.  Timers that are
+  // too far in the future for the wheel are kept in an overflow list.
+  static const int LEVELS = 4;
+  static const int SLOT_BITS = 6;
+  static const int SLOTS = 1 << SLOT_BITS;
+  static const int SLOT_MASK = SLOTS - 1;
+
+  // Returns the first tick at or after the given timeout in microseconds.
+  static int64 tick_for(int64 timeout);
+
+  void insert(Timer* timer);
+  void cascade(TimerList* list);
+  // Returns the first tick that has work to do, or INT64_MAX if there are no
+  // armed timers.
+  int64 next_tick();
+  void process_tick(Locker& locker, int64 tick);
+
   static TimerEventSource* _instance;
 
   ConditionVariable* _timer_changed;
-  TimerList _timers;
+  TimerList _wheel[LEVELS][SLOTS];
+  uint64 _occupied[LEVELS];  // Bitmaps of the slots that may be non-empty.
+  TimerList _overflow;
+  int64 _current_tick;  // All ticks before this one have been processed.
   bool _stop;
 };
 
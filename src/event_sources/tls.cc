@@ -15,11 +15,27 @@
 
 #include "tls.h"
 
+#include "../flags.h"
 #include "../objects_inline.h"
 #include "../utils.h"
 
 namespace toit {
 
+class TLSHandshakeThread : public Thread {
+ public:
+  explicit TLSHandshakeThread(TLSEventSource* event_source)
+      : Thread("TLS")
+      , _event_source(event_source) {}
+
+ protected:
+  void entry() override {
+    _event_source->run_handshakes();
+  }
+
+ private:
+  TLSEventSource* _event_source;
+};
+
 TLSEventSource* TLSEventSource::_instance = null;
 
 TLSEventSource* TLSEventSource::instance() {
@@ -27,12 +43,12 @@ TLSEventSource* TLSEventSource::instance() {
 }
 
 TLSEventSource::TLSEventSource()
-    : LazyEventSource("TLS", 1)
-    , Thread("TLS") {
+    : LazyEventSource("TLS", 1) {
 }
 
 TLSEventSource::~TLSEventSource() {
   OS::dispose(_sockets_changed);
+  OS::dispose(_handshake_done);
   _instance = null;
 }
 
@@ -41,52 +57,129 @@ bool TLSEventSource::start() {
 
   _sockets_changed = OS::allocate_condition_variable(mutex());
   if (_sockets_changed == null) return false;
-
-  if (!spawn(5 * KB)) return false;
+  _handshake_done = OS::allocate_condition_variable(mutex());
+  if (_handshake_done == null) return false;
+
+  int count = Flags::tls_handshake_threads;
+  if (count <= 0) {
+#ifdef TOIT_FREERTOS
+    // Each concurrent handshake needs more than 12k of memory.
+    count = 1;
+#else
+    count = OS::num_cores();
+#endif
+  }
+  _threads = _new TLSHandshakeThread*[count];
+  if (_threads == null) return false;
+  for (int i = 0; i < count; i++) {
+    _threads[i] = _new TLSHandshakeThread(this);
+    if (_threads[i] == null || !_threads[i]->spawn(5 * KB)) {
+      delete _threads[i];
+      break;
+    }
+    _thread_count++;
+  }
+  if (_thread_count == 0) {
+    delete[] _threads;
+    _threads = null;
+    return false;
+  }
 
   return true;
 }
 
 void TLSEventSource::stop() {
   {
-    // Stop the main thread.
+    // Stop the handshake threads.
     Locker locker(mutex());
     _stop = true;
 
-    OS::signal(_sockets_changed);
+    OS::signal_all(_sockets_changed);
   }
 
-  join();
+  for (int i = 0; i < _thread_count; i++) {
+    _threads[i]->join();
+    delete _threads[i];
+  }
+  delete[] _threads;
+  _threads = null;
+  _thread_count = 0;
 }
 
 void TLSEventSource::handshake(TLSSocket* socket) {
   Locker locker(mutex());
   _sockets.append(socket);
+  _queue_depth++;
+  _max_queue_depth = Utils::max(_max_queue_depth, _queue_depth);
   OS::signal(_sockets_changed);
 }
 
 void TLSEventSource::on_unregister_resource(Locker& locker, Resource* r) {
   ASSERT(is_locked());
   TLSSocket* socket = r->as<TLSSocket*>();
-  _sockets.remove(socket);
+  if (_sockets.remove(socket) != null) _queue_depth--;
+  // The socket is deleted once we return, so we must wait for any ongoing
+  // handshake step on it to complete.
+  while (socket->is_in_handshake()) OS::wait(_handshake_done);
 }
 
-void TLSEventSource::entry() {
+void TLSEventSource::handshake_stats(int64* values) {
+  // The global mutex keeps the instance alive while we read it.
+  Locker global_locker(OS::global_mutex());
+  TLSEventSource* source = _instance;
+  if (source == null) {
+    for (int i = 0; i < HANDSHAKE_STATS_LENGTH; i++) values[i] = 0;
+    return;
+  }
+  source->read_handshake_stats(values);
+}
+
+void TLSEventSource::read_handshake_stats(int64* values) {
+  Locker locker(mutex());
+  values[0] = _thread_count;
+  values[1] = _queue_depth;
+  values[2] = _max_queue_depth;
+  values[3] = _active_handshakes;
+  values[4] = _handshake_count;
+  values[5] = _total_handshake_us;
+  values[6] = _max_handshake_us;
+}
+
+void TLSEventSource::run_handshakes() {
   Locker locker(mutex());
 
   while (!_stop) {
-    while (true) {
-      TLSSocket* socket = _sockets.remove_first();
-      if (socket == null) break;
-
-      // Keep locker while handshake is going on, to avoid conflicting remove.
-      // If we want to better support multiple concurrent handshakes, this
-      // can be further optimized but will be quite complex.
-      word result = socket->handshake();
+    TLSSocket* socket = _sockets.remove_first();
+    if (socket == null) {
+      OS::wait(_sockets_changed);
+      continue;
+    }
+    _queue_depth--;
+
+    // Run the handshake step without the lock, so other threads can run
+    // handshakes on other sockets.  Unregistering the socket waits until we
+    // are done with it.
+    socket->set_in_handshake(true);
+    _active_handshakes++;
+    int64 start = OS::get_monotonic_time();
+    word result;
+    {
+      Unlocker unlock(locker);
+      result = socket->handshake();
+    }
+    int64 elapsed = OS::get_monotonic_time() - start;
+    _active_handshakes--;
+    _handshake_count++;
+    _total_handshake_us += elapsed;
+    _max_handshake_us = Utils::max(_max_handshake_us, elapsed);
+    socket->set_in_handshake(false);
+
+    if (resources().is_linked(socket)) {
       dispatch(locker, socket, result);
+    } else {
+      // The socket is being unregistered.
+      OS::signal_all(_handshake_done);
     }
-
-    OS::wait(_sockets_changed);
   }
 }
 
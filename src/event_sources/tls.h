@@ -22,6 +22,7 @@
 namespace toit {
 
 class TLSSocket;
+class TLSHandshakeThread;
 
 typedef LinkedFIFO<TLSSocket, 1> TLSSocketList;
 
@@ -31,9 +32,19 @@ class TLSSocket : public Resource, public TLSSocketList::Element {
     : Resource(resource_group) { }
 
   virtual word handshake() = 0;
+
+  // Set while a handshake thread is running a handshake step on this socket,
+  // without holding the event source lock.
+  bool is_in_handshake() const { return _in_handshake; }
+  void set_in_handshake(bool value) { _in_handshake = value; }
+
+ private:
+  bool _in_handshake = false;
 };
 
-class TLSEventSource : public LazyEventSource, public Thread {
+// Runs the potentially slow handshake steps of TLS sockets on a pool of
+// threads, so a slow handshake does not hold up the others.
+class TLSEventSource : public LazyEventSource {
  public:
   static TLSEventSource* instance();
 
@@ -47,16 +58,37 @@ class TLSEventSource : public LazyEventSource, public Thread {
 
   void handshake(TLSSocket* socket);
 
+  // Copies the handshake counters to the given array:
+  // threads, queue depth, max queue depth, active handshakes,
+  // handshake steps, total handshake time (us), max handshake time (us).
+  // All zeros if no TLS connection is currently using the event source.
+  static const int HANDSHAKE_STATS_LENGTH = 7;
+  static void handshake_stats(int64* values);
+
  protected:
   friend class LazyEventSource;
   static TLSEventSource* _instance;
 
  private:
-  void entry() override;
+  friend class TLSHandshakeThread;
+  void run_handshakes();
+  void read_handshake_stats(int64* values);
 
   ConditionVariable* _sockets_changed = null;
+  ConditionVariable* _handshake_done = null;
   TLSSocketList _sockets;
   bool _stop = false;
+
+  int _thread_count = 0;
+  TLSHandshakeThread** _threads = null;
+
+  // Counters.
+  int _queue_depth = 0;
+  int _max_queue_depth = 0;
+  int _active_handshakes = 0;
+  int64 _handshake_count = 0;
+  int64 _total_handshake_us = 0;
+  int64 _max_handshake_us = 0;
 };
 
 } // namespace toit
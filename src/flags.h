@@ -39,9 +39,11 @@ namespace toit {
   FLAG_BOOL(deploy,  no_fork,               false, "Don't fork the compiler")       \
                                                                                     \
   FLAG_BOOL(debug,   trace,                 false, "Trace interpreter")             \
+  FLAG_BOOL(debug,   bytecode_sequences,    false, "Count bytecode pairs and triples, and suggest superinstructions") \
   FLAG_BOOL(debug,   primitives,            false, "Trace primitives")              \
   FLAG_BOOL(debug,   tracegc,               false, "Trace garbage collector")       \
   FLAG_BOOL(debug,   gcalot,                false, "Garbage collect after each allocation in the interpreter") \
+  FLAG_BOOL(deploy,  generational,          false, "Promote scavenge survivors to an old space that is collected less often") \
   FLAG_BOOL(debug,   preemptalot,           false, "Preempt process after each pop bytecode") \
   FLAG_BOOL(debug,   lookup,                false, "Trace lookup")                  \
   FLAG_BOOL(debug,   allocation,            false, "Trace object allocation")       \
@@ -57,6 +59,13 @@ namespace toit {
   FLAG_BOOL(debug,   print_dependency_tree, false, "Prints the dependency tree used in the source-shaking")               \
   FLAG_BOOL(deploy,  enable_asserts,        _ASSERT_DEFAULT, "Enables asserts")     \
   FLAG_INT(deploy,   max_recursion_depth,   2000,  "Max recursion depth in the parser") \
+  FLAG_INT(deploy,   tls_handshake_threads, 0,     "Number of TLS handshake threads (0 for default)") \
+  FLAG_INT(deploy,   time_slice_ms,         20,    "Time slice of a process with default priority") \
+  FLAG_BOOL(deploy,  fifo_scheduling,       false, "Run ready processes in FIFO order instead of by virtual runtime") \
+  FLAG_INT(deploy,   scheduler_threads,     0,     "Number of scheduler threads (0 for one per core)") \
+  FLAG_INT(deploy,   compiler_threads,      0,     "Number of threads that parse sources (0 for one per core)") \
+  FLAG_INT(deploy,   heap_arena_mb,         16384, "Address space reserved for heap blocks on 64 bit Linux (0 to map each block)") \
+  FLAG_STRING(deploy, huge_pages,           null,  "Huge pages for the Linux heap arena: transparent or explicit") \
   FLAG_STRING(deploy, lib_path,             null,  "The library path")              \
   FLAG_STRING(deploy, archive_entry_path,   null,  "The entry path in an archive")  \
   FLAG_STRING(deploy, sandbox,              null,  "syscall-sandbox: compiler or sandbox")  \
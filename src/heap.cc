@@ -33,17 +33,24 @@
 
 namespace toit {
 
-class ScavengeScope : public Locker {
+// Heaps belong to a single process, so different heaps can be scavenged in
+// parallel.  The heap memory takes its own lock for each block operation.
+class ScavengeScope {
  public:
-  ScavengeScope(HeapMemory* heap_memory, RawHeap* heap)
-      : Locker(heap_memory->mutex())
-      , _heap_memory(heap_memory)
+  ScavengeScope(HeapMemory* heap_memory, RawHeap* heap, bool reserve = true)
+      : _heap_memory(heap_memory)
       , _heap(heap) {
-    heap_memory->enter_scavenge(heap);
+#ifdef TOIT_FREERTOS
+    OS::lock(heap_memory->scavenge_mutex());
+#endif
+    heap_memory->enter_scavenge(heap, reserve);
   }
 
   ~ScavengeScope() {
     _heap_memory->leave_scavenge(_heap);
+#ifdef TOIT_FREERTOS
+    OS::unlock(_heap_memory->scavenge_mutex());
+#endif
   }
 
  private:
@@ -64,8 +71,9 @@ Heap::Heap(Process* owner, Program* program, Block* initial_block)
 
 Heap::~Heap() {
   set_writable(true);
-  // Deleting a heap is like a scavenge where nothing survives.
-  ScavengeScope scope(VM::current()->heap_memory(), this);
+  // Deleting a heap is like a scavenge where nothing survives, so it needs
+  // no reserve.
+  ScavengeScope scope(VM::current()->heap_memory(), this, false);
   _blocks.free_blocks(this);
 }
 
@@ -86,7 +94,7 @@ Instance* Heap::allocate_instance(TypeTag class_tag, Smi* class_id, Smi* instanc
 Array* Heap::allocate_array(int length, Object* filler) {
   ASSERT(length >= 0);
   ASSERT(length <= Array::max_length());
-  HeapObject* result = _allocate_raw(Array::allocation_size(length));
+  HeapObject* result = _allocate_raw_or_large(Array::allocation_size(length));
   if (result == null) {
     return null;  // Allocation failure.
   }
@@ -99,7 +107,7 @@ Array* Heap::allocate_array(int length, Object* filler) {
 Array* Heap::allocate_array(int length) {
   ASSERT(length >= 0);
   ASSERT(length <= Array::max_length());
-  HeapObject* result = _allocate_raw(Array::allocation_size(length));
+  HeapObject* result = _allocate_raw_or_large(Array::allocation_size(length));
   if (result == null) {
     return null;  // Allocation failure.
   }
@@ -113,7 +121,7 @@ ByteArray* Heap::allocate_internal_byte_array(int length) {
   ASSERT(length >= 0);
   // Byte array should fit within one heap block.
   ASSERT(length <= ByteArray::max_internal_size());
-  ByteArray* result = unvoid_cast<ByteArray*>(_allocate_raw(ByteArray::internal_allocation_size(length)));
+  ByteArray* result = unvoid_cast<ByteArray*>(_allocate_raw_or_large(ByteArray::internal_allocation_size(length)));
   if (result == null) return null;  // Allocation failure.
   // Initialize object.
   result->_set_header(_program, _program->byte_array_class_id());
@@ -146,7 +154,7 @@ int Heap::payload_size() {
 String* Heap::allocate_internal_string(int length) {
   ASSERT(length >= 0);
   ASSERT(length <= String::max_internal_size());
-  HeapObject* result = _allocate_raw(String::internal_allocation_size(length));
+  HeapObject* result = _allocate_raw_or_large(String::internal_allocation_size(length));
   if (result == null) return null;
   // Initialize object.
   Smi* string_id = program()->string_class_id();
@@ -176,6 +184,7 @@ HeapObject* Heap::_allocate_raw(int byte_size) {
   }
   if (result == null) return null;
   _total_bytes_allocated += byte_size;
+  if (_allocation_profiler != null) _allocation_profiler->allocated(result, byte_size);
   return result;
 }
 
@@ -187,7 +196,7 @@ Heap::AllocationResult Heap::_expand() {
 }
 
 Heap::AllocationResult ObjectHeap::_expand() {
-  word used = (_blocks.length() << TOIT_PAGE_SIZE_LOG2) + _external_memory;
+  word used = (_number_of_pages() << TOIT_PAGE_SIZE_LOG2) + _external_memory;
   if (_limit != 0 && used >= _limit) {
 #ifdef TOIT_FREERTOS
     printf("[gc @ %p%s | soft limit reached (%zd >= %zd)]\n",
@@ -199,15 +208,55 @@ Heap::AllocationResult ObjectHeap::_expand() {
   return Heap::_expand();
 }
 
+HeapObject* ObjectHeap::_allocate_large(int byte_size) {
+  ASSERT(byte_size <= Block::max_large_object_size());
+  word used = (_number_of_pages() << TOIT_PAGE_SIZE_LOG2) + _external_memory;
+  if (_limit != 0 && used >= _limit) {
+    set_last_allocation_result(ALLOCATION_HIT_LIMIT);
+    return null;
+  }
+  Block* block = VM::current()->heap_memory()->allocate_large_block(this, byte_size);
+  if (block == null) {
+    set_last_allocation_result(ALLOCATION_OUT_OF_MEMORY);
+    return null;
+  }
+  block->set_large();
+  _large_blocks.append(block);
+  _large_block_pages += block->pages();
+  HeapObject* result = HeapObject::cast(block->base());
+  _total_bytes_allocated += byte_size;
+  if (_allocation_profiler != null) _allocation_profiler->allocated(result, byte_size);
+  return result;
+}
+
 class ScavengeState : public RootCallback {
  public:
-  explicit ScavengeState(Heap* heap)
-      : _heap(heap), _scope(VM::current()->heap_memory(), heap) {
+  // A minor scavenge only copies young objects.  Old objects are left in
+  // place, and the remembered old blocks are treated as roots.
+  //
+  // Objects in the large blocks are never moved.  They are marked when they
+  // are reached, and their fields are processed by [process_large_objects].
+  ScavengeState(Heap* heap, bool minor, BlockList* large_blocks)
+      : _heap(heap)
+      , _minor(minor)
+      , _large_blocks(large_blocks)
+      , _scope(VM::current()->heap_memory(), heap) {
     blocks.append(VM::current()->heap_memory()->allocate_block_during_scavenge(heap));
   }
 
   static bool is_forward_address(Object* object) { return object->is_heap_object(); }
 
+  bool is_minor() const { return _minor; }
+
+  // Whether the object survives this scavenge.  Only valid after all roots
+  // have been processed.
+  bool is_alive(HeapObject* object) {
+    Block* block = Block::from(object);
+    if (_minor && block->is_old()) return true;
+    if (block->is_large()) return block->is_marked();
+    return is_forward_address(object->header_during_gc());
+  }
+
   HeapObject* allocate(int byte_size) {
     HeapObject* result = blocks.last()->allocate_raw(byte_size);
     if (result == null) {
@@ -234,6 +283,9 @@ class ScavengeState : public RootCallback {
       result = allocate(Stack::allocation_size(new_length));
       // As the size could have changed, use stack-specific method for copying content.
       stack->copy_to(result, new_length);
+      // Stacks are written without a write barrier, so a block containing a
+      // stack must always be scanned by minor scavenges.
+      Block::from(result)->set_has_stacks();
     } else {
       result = allocate(object_size);
       // Copy the object content raw to the destination.
@@ -256,6 +308,16 @@ class ScavengeState : public RootCallback {
       if (!content->is_heap_object()) continue;  // Do nothing.
       HeapObject* heap_object = HeapObject::cast(content);
       if (Heap::in_read_only_program_heap(heap_object, _heap)) continue;  // Do nothing, content is outside heap.
+      Block* block = Block::from(heap_object);
+      if (_minor && block->is_old()) continue;  // Do nothing, old objects are not moved.
+      if (block->is_large()) {
+        // Large objects are not moved either, but must be processed once.
+        if (!block->is_marked()) {
+          block->set_marked();
+          _unscanned_large_objects++;
+        }
+        continue;
+      }
       Object* header = HeapObject::cast(content)->header_during_gc();
       roots[i] = is_forward_address(header)          // Check whether there is a forward address.
           ? header                                   // if so, update the root with the forwarding.
@@ -271,15 +333,54 @@ class ScavengeState : public RootCallback {
     }
   }
 
+  // Treats all objects in the remembered old blocks as roots.
+  void process_remembered_blocks(BlockList& old_blocks) {
+    ASSERT(_minor);
+    Program* program = _heap->program();
+    for (auto block : old_blocks) {
+      if (!block->is_remembered()) continue;
+      if (Flags::tracegc && Flags::verbose) printf(" - process remembered block %p\n", block);
+      for (void* p = block->base(); p < block->top(); p = Utils::address_at(p, HeapObject::cast(p)->size(program))) {
+        HeapObject::cast(p)->roots_do(program, this);
+      }
+    }
+  }
+
+  // Processes the fields of the large objects that were marked since the
+  // last call.  Returns false if there were none.
+  bool process_large_objects() {
+    if (_unscanned_large_objects == 0) return false;
+    Program* program = _heap->program();
+    for (auto block : *_large_blocks) {
+      if (!block->is_marked() || block->is_scanned()) continue;
+      if (Flags::tracegc && Flags::verbose) printf(" - process large object in block %p\n", block);
+      block->set_scanned();
+      _unscanned_large_objects--;
+      HeapObject::cast(block->base())->roots_do(program, this);
+    }
+    return true;
+  }
+
+  // Processes the to space and the newly marked large objects until there
+  // is nothing left to do.
+  void process_all(Heap::Iterator& objects) {
+    do {
+      process_to_objects(objects);
+    } while (process_large_objects());
+  }
+
   void process_to_space() {
     Heap::Iterator objects(blocks, _heap->program());
-    while (!objects.eos()) process_to_objects(objects);
+    process_all(objects);
     ASSERT(objects.eos());
   }
 
   BlockList blocks;
  private:
   Heap* _heap;
+  bool _minor;
+  BlockList* _large_blocks;
+  int _unscanned_large_objects = 0;
   ScavengeScope _scope;
 };
 
@@ -329,7 +430,9 @@ ObjectHeap::ObjectHeap(Program* program, Process* owner, Block* block)
     , _external_memory(0)
     , _hatch_method(Method::invalid())
     , _finalizer_notifier(null)
-    , _gc_count(0) {
+    , _gc_count(0)
+    , _old_space_limit(_MIN_BLOCK_LIMIT)
+    , _total_bytes_allocated_at_last_scavenge(-1) {
   _task = allocate_task();
   _global_variables = _copy_global_variables();
   // Currently the heap is empty and it has one block allocated for objects.
@@ -353,12 +456,16 @@ ObjectHeap::~ObjectHeap() {
   }
 
   delete _finalizer_notifier;
+  delete _allocation_profiler;
 
   ASSERT(_object_notifiers.is_empty());
+
+  ScavengeScope scope(VM::current()->heap_memory(), this, false);
+  _large_blocks.free_blocks(this);
 }
 
 word ObjectHeap::_calculate_limit() {
-  word length = ((_blocks.length() + 2) << TOIT_PAGE_SIZE_LOG2) + _external_memory;
+  word length = ((_number_of_pages() + 2) << TOIT_PAGE_SIZE_LOG2) + _external_memory;
   word new_limit = Utils::max(_MIN_BLOCK_LIMIT << TOIT_PAGE_SIZE_LOG2, length + length / 2);
   if (has_max_heap_size()) {
     new_limit = Utils::min(_max_heap_size, new_limit);
@@ -393,10 +500,16 @@ void ObjectHeap::unregister_external_allocation(word size) {
 }
 
 int ObjectHeap::payload_size() {
-  int base = Heap::payload_size();
+  int base = Heap::payload_size() + _large_blocks.payload_size();
   return base + sizeof(Object*) * (program()->global_variables.length());
 }
 
+Usage ObjectHeap::usage(const char* name) {
+  int allocated = _number_of_pages() * TOIT_PAGE_SIZE;
+  int used = object_size() + _large_blocks.payload_size();
+  return Usage(name, allocated, used);
+}
+
 ByteArray* Heap::allocate_external_byte_array(int length, uint8* memory, bool dispose, bool clear_content) {
   ByteArray* result = unvoid_cast<ByteArray*>(_allocate_raw(ByteArray::external_allocation_size()));
   if (result == null) return null;  // Allocation failure.
@@ -416,6 +529,13 @@ ByteArray* Heap::allocate_external_byte_array(int length, uint8* memory, bool di
   return result;
 }
 
+ByteArray* Heap::allocate_shared_byte_array(SharedBuffer* buffer, bool is_owner) {
+  ByteArray* result = allocate_external_byte_array(buffer->length(), buffer->data(), true, false);
+  if (result == null) return null;  // Allocation failure.
+  result->_set_external_tag(is_owner ? SharedBufferOwnerTag : SharedBufferTag);
+  return result;
+}
+
 String* Heap::allocate_external_string(int length, uint8* memory, bool dispose) {
 
   String* result = unvoid_cast<String*>(_allocate_raw(String::external_allocation_size()));
@@ -474,23 +594,41 @@ Stack* ObjectHeap::allocate_stack(int length) {
 }
 
 int ObjectHeap::scavenge() {
-  int blocks_before = _blocks.length();
+  int blocks_before = _number_of_pages();
 #ifdef TOIT_FREERTOS
   word external_memory_before = _external_memory;
   word free_before = static_cast<word>(heap_caps_get_free_size(MALLOC_CAP_8BIT));
   int64 start_time = OS::get_monotonic_time();
 #endif
 
+  // In generational mode we only collect the young objects, unless the old
+  // space has outgrown its limit, or nothing was allocated since the last
+  // scavenge, which means a minor scavenge was not enough to satisfy the
+  // allocation.
+  bool minor = Flags::generational
+      && _blocks.old_length() + _large_block_pages < _old_space_limit
+      && _total_bytes_allocated != _total_bytes_allocated_at_last_scavenge;
+
   enter_gc();
   // Reset this until we get a new failure after GC.
   set_last_allocation_result(ALLOCATION_SUCCESS);
   if (Flags::tracegc) {
-    printf("[Begin object scavenge #(%zdk, %zdk, external %zdk)]\n",
-           _blocks.length() << (TOIT_PAGE_SIZE_LOG2 - KB_LOG2),
+    printf("[Begin %s object scavenge #(%zdk, %zdk, external %zdk)]\n",
+           minor ? "minor" : "full",
+           _number_of_pages() << (TOIT_PAGE_SIZE_LOG2 - KB_LOG2),
            _limit >> KB_LOG2,
            _external_memory >> KB_LOG2);
   }
-  ScavengeState ss(this);
+  ScavengeState ss(this, minor, &_large_blocks);
+
+  // In a minor scavenge the old blocks are kept, and only the young blocks
+  // are freed when the scavenge completes.
+  BlockList old_blocks;
+  if (minor) {
+    _blocks.take_old_blocks(&old_blocks);
+    ss.process_remembered_blocks(old_blocks);
+    ss.process_remembered_blocks(_large_blocks);
+  }
 
   // Process the roots in the object heap.
   ss.do_root(reinterpret_cast<Object**>(&_task));
@@ -507,13 +645,13 @@ int ObjectHeap::scavenge() {
 
   // Process the to space.
   Iterator objects(ss.blocks, program());
-  while (!objects.eos()) ss.process_to_objects(objects);
+  ss.process_all(objects);
 
   // Process the registered finalizer list.
   if (!_registered_finalizers.is_empty() && Flags::tracegc && Flags::verbose) printf(" - Processing registered finalizers\n");
   ObjectHeap* heap = this;
   _registered_finalizers.remove_wherever([&ss, heap](FinalizerNode* node) -> bool {
-    bool is_alive = ScavengeState::is_forward_address(node->key()->header_during_gc());
+    bool is_alive = ss.is_alive(node->key());
     if (!is_alive) {
       // Clear the key so it is not retained.
       node->set_key(heap->program()->null_object());
@@ -532,12 +670,12 @@ int ObjectHeap::scavenge() {
   });
 
   // Process the finalizers in the to space.
-  while (!objects.eos()) ss.process_to_objects(objects);
+  ss.process_all(objects);
   ASSERT(objects.eos());
 
   // Process registered VM finalizers.
   _registered_vm_finalizers.remove_wherever([&ss, this](VMFinalizerNode* node) -> bool {
-    bool is_alive = ScavengeState::is_forward_address(node->key()->header_during_gc());
+    bool is_alive = ss.is_alive(node->key());
 
     if (is_alive && Flags::tracegc && Flags::verbose) printf(" - Finalizer %p is alive\n", node);
     if (is_alive) {
@@ -551,22 +689,50 @@ int ObjectHeap::scavenge() {
   });
 
   // Complete the scavenge.
-  while (!objects.eos()) ss.process_to_objects(objects);
+  ss.process_all(objects);
   ASSERT(objects.eos());
 
-  take_blocks(&ss.blocks);
+  // The sampled allocations are weak references.
+  if (_allocation_profiler != null) {
+    _allocation_profiler->scavenge_samples([&ss](HeapObject* object) -> HeapObject* {
+      if (!ss.is_alive(object)) return null;
+      Object* header = object->header_during_gc();
+      return ScavengeState::is_forward_address(header) ? HeapObject::cast(header) : object;
+    });
+  }
+
+  _sweep_large_objects(minor);
+
+  if (Flags::generational) {
+    // All survivors are promoted.  Since they can only point to other old
+    // objects, none of the old blocks need to be remembered any more.
+    for (auto block : ss.blocks) block->set_old();
+    old_blocks.append_blocks(&ss.blocks);
+    for (auto block : old_blocks) block->clear_remembered();
+    // New objects must not be allocated in old blocks.
+    old_blocks.append(VM::current()->heap_memory()->allocate_block_during_scavenge(this));
+    // Frees the young blocks, and in a full scavenge also the old ones.
+    take_blocks(&old_blocks);
+    if (!minor) {
+      _old_space_limit = Utils::max(_MIN_BLOCK_LIMIT, _number_of_pages() * 2);
+    }
+  } else {
+    take_blocks(&ss.blocks);
+  }
+  _total_bytes_allocated_at_last_scavenge = _total_bytes_allocated;
   _pending_limit = _calculate_limit();  // GC limit to install after next GC.
   _limit = _max_heap_size;  // Only the hard limit for the rest of this primitive.
   if (Flags::tracegc) {
-    printf("[End object scavenge #(%zdk, %zdk, external %zdk)]\n",
-           _blocks.length() << (TOIT_PAGE_SIZE_LOG2 - KB_LOG2),
+    printf("[End %s object scavenge #(%zdk, %zdk, external %zdk)]\n",
+           minor ? "minor" : "full",
+           _number_of_pages() << (TOIT_PAGE_SIZE_LOG2 - KB_LOG2),
            _pending_limit >> KB_LOG2,
            _external_memory >> KB_LOG2);
   }
   _gc_count++;
   leave_gc();
 
-  int blocks_after = _blocks.length();
+  int blocks_after = _number_of_pages();
 #ifdef TOIT_FREERTOS
   multi_heap_info_t info;
   heap_caps_get_info(&info, MALLOC_CAP_8BIT);
@@ -587,6 +753,47 @@ int ObjectHeap::scavenge() {
   return blocks_before - blocks_after;
 }
 
+void ObjectHeap::_sweep_large_objects(bool minor) {
+  // Minor scavenges don't mark the large objects, which are old.
+  BlockList live;
+  BlockList dead;
+  while (auto block = _large_blocks.remove_first()) {
+    if (minor || block->is_marked()) {
+      block->clear_marks();
+      block->clear_remembered();
+      live.append(block);
+    } else {
+      _large_block_pages -= block->pages();
+      dead.append(block);
+    }
+  }
+  dead.free_blocks(this);
+  _large_blocks.append_blocks(&live);
+}
+
+int ObjectHeap::install_allocation_profiler(int interval) {
+  ASSERT(_allocation_profiler == null);
+  AllocationProfiler* profiler = _new AllocationProfiler(interval);
+  if (profiler == null) return -1;
+  int result = profiler->allocated_bytes();
+  if (result == -1) {
+    delete profiler;
+  } else {
+    _allocation_profiler = profiler;
+  }
+  return result;
+}
+
+void ObjectHeap::uninstall_allocation_profiler() {
+  AllocationProfiler* profiler = _allocation_profiler;
+  _allocation_profiler = null;
+  delete profiler;
+}
+
+void ObjectHeap::_resolve_allocation_samples(uint8* bcp) {
+  _allocation_profiler->resolve_samples(program()->absolute_bci_from_bcp(bcp));
+}
+
 bool ObjectHeap::has_finalizer(HeapObject* key, Object* lambda) {
   for (FinalizerNode* node : _registered_finalizers) {
     if (node->key() == key) return true;
@@ -659,6 +866,14 @@ void VMFinalizerNode::free_external_memory(Process* process) {
   if (key()->is_byte_array()) {
     ByteArray* byte_array = ByteArray::cast(key());
     if (byte_array->external_tag() == MappedFileTag) return;  // TODO(Lau): release mapped file, so flash storage can be reclaimed.
+    if (byte_array->has_shared_content()) {
+      SharedBuffer* buffer = SharedBuffer::from_data(byte_array->_external_address());
+      if (byte_array->external_tag() == SharedBufferOwnerTag) {
+        process->unregister_external_allocation(SharedBuffer::allocation_size(buffer->length()));
+      }
+      buffer->release();
+      return;
+    }
     ASSERT(byte_array->has_external_address());
     memory = byte_array->as_external();
     accounting_size = ByteArray::Bytes(byte_array).length();
@@ -22,6 +22,7 @@
 #include "objects.h"
 #include "primitive.h"
 #include "printing.h"
+#include "profiler.h"
 #include "snapshot.h"
 
 #include "objects_inline.h"
@@ -56,6 +57,12 @@ class Heap : public RawHeap {
 
   static int max_allocation_size() { return Block::max_payload_size(); }
 
+  // Arrays, byte arrays and strings of at least this size get a block of
+  // their own in object heaps, so they are not copied by the scavenger.
+  // Smaller objects are bump allocated in the shared blocks, where a big
+  // object would waste the rest of a block.
+  static int large_object_size() { return Block::max_payload_size() / 4; }
+
   // Shared allocation operations.
   Instance* allocate_instance(Smi* class_id);
   Instance* allocate_instance(TypeTag class_tag, Smi* class_id, Smi* instance_size);
@@ -63,6 +70,8 @@ class Heap : public RawHeap {
   Array* allocate_array(int length);
   ByteArray* allocate_external_byte_array(int length, uint8* memory, bool dispose, bool clear_content = true);
   String* allocate_external_string(int length, uint8* memory, bool dispose);
+  // Takes over one reference to the [buffer].
+  ByteArray* allocate_shared_byte_array(SharedBuffer* buffer, bool is_owner);
   ByteArray* allocate_internal_byte_array(int length);
   String* allocate_internal_string(int length);
   Double* allocate_double(double value);
@@ -136,10 +145,18 @@ class Heap : public RawHeap {
   Program* const _program;
   HeapObject* _allocate_raw(int byte_size);
   virtual AllocationResult _expand();
+  // Allocates an object that does not need to be moved by the scavenger, and
+  // which does not contain any pointers written without a write barrier.
+  HeapObject* _allocate_raw_or_large(int byte_size) {
+    if (byte_size >= large_object_size()) return _allocate_large(byte_size);
+    return _allocate_raw(byte_size);
+  }
+  virtual HeapObject* _allocate_large(int byte_size) { return _allocate_raw(byte_size); }
   bool _in_gc;
   bool _gc_allowed;
   int64 _total_bytes_allocated;
   AllocationResult _last_allocation_result;
+  AllocationProfiler* _allocation_profiler = null;
 
   friend class ProgramSnapshotReader;
   friend class ObjectAllocator;
@@ -275,6 +292,8 @@ class ObjectHeap final : public Heap {
   // Returns the number of bytes allocated in this heap.
   virtual int payload_size();
 
+  Usage usage(const char* name);
+
   Task* allocate_task();
   Stack* allocate_stack(int length);
   // Convenience methods for allocating proxy like objects.
@@ -320,6 +339,20 @@ class ObjectHeap final : public Heap {
   bool has_max_heap_size() const { return _max_heap_size != 0; }
   void install_heap_limit() { _limit = _pending_limit; }
 
+  // Returns the number of bytes used by the profiler, or -1 if it couldn't
+  // be allocated.
+  int install_allocation_profiler(int interval);
+  AllocationProfiler* allocation_profiler() { return _allocation_profiler; }
+  void uninstall_allocation_profiler();
+
+  // Attributes the allocations sampled since the last call to the bytecode
+  // at [bcp].  Called by the interpreter after the bytecodes that allocate.
+  void record_allocation_site(uint8* bcp) {
+    if (_allocation_profiler != null && _allocation_profiler->has_unresolved_samples()) {
+      _resolve_allocation_samples(bcp);
+    }
+  }
+
  private:
   // An estimate of how much memory overhead malloc has.
   static const word _EXTERNAL_MEMORY_ALLOCATOR_OVERHEAD = 2 * sizeof(word);
@@ -347,14 +380,34 @@ class ObjectHeap final : public Heap {
   int _gc_count;
   Object** _global_variables;
 
+  // Number of old blocks before we force a full scavenge in generational mode.
+  word _old_space_limit;
+  // Used to detect that a minor scavenge did not free enough memory.
+  int64 _total_bytes_allocated_at_last_scavenge;
+
   Object** _copy_global_variables();
 
   HeapRootList _external_roots;
 
+  // Blocks that each hold a single large object.  They are not part of
+  // _blocks, and don't count towards the memory reserved for scavenges,
+  // because their objects are never copied.
+  BlockList _large_blocks;
+
+  // Number of pages spanned by the large blocks.
+  word _large_block_pages = 0;
+
+  // Number of pages used by this heap, including large objects.
+  word _number_of_pages() const { return _blocks.length() + _large_block_pages; }
+
   // Calculate the memory limit for scavenge based on the number of live blocks
   // and the externally allocated memory.
   word _calculate_limit();
   AllocationResult _expand();
+  HeapObject* _allocate_large(int byte_size);
+  void _sweep_large_objects(bool minor);
+
+  void _resolve_allocation_samples(uint8* bcp);
 
   friend class ObjectNotifier;
 };
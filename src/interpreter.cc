@@ -34,7 +34,9 @@ Interpreter::Interpreter()
     , _sp(null)
     , _try_sp(null)
     , _watermark(null)
-    , _in_stack_overflow(false) {
+    , _in_stack_overflow(false)
+    , _sequence_bcp(null)
+    , _sequence_previous(ILLEGAL_END) {
 #ifdef PROFILER
   _is_profiler_active = false;
 #endif
@@ -207,7 +209,7 @@ bool Interpreter::fast_at(Process* process, Object* receiver, Object* arg, bool
   } else if (byte_array != null &&
        (!byte_array->has_external_address() ||
         byte_array->external_tag() == RawByteTag ||
-        (!is_put && byte_array->external_tag() == MappedFileTag))) {
+        (!is_put && (byte_array->external_tag() == MappedFileTag || byte_array->has_shared_content())))) {
     ByteArray::Bytes bytes(byte_array);
     if (!bytes.is_valid_index(n)) return false;
 
@@ -456,6 +458,137 @@ void Interpreter::_trace(uint8* bcp) {
 #endif
 }
 
+// Dynamic counts for the bytecode_sequences flag.  Only bytecodes that fall
+// through to the next one are counted, since those are the sequences that can
+// become superinstructions.  The counts are shared by all interpreters without
+// synchronization, so they are approximate when processes run in parallel.
+static const int OPCODE_COUNT = ILLEGAL_END;
+static uint64 sequence_dispatches = 0;
+static uint32* pair_counts = null;
+static uint32* triple_counts = null;
+
+#define BYTECODE_NAME(name, length, format, print) #name,
+static const char* sequence_opcode_name[] { BYTECODES(BYTECODE_NAME) };
+#undef BYTECODE_NAME
+#define BYTECODE_LENGTH(name, length, format, print) length,
+static const int sequence_opcode_length[] { BYTECODES(BYTECODE_LENGTH) };
+#undef BYTECODE_LENGTH
+#define BYTECODE_FORMAT(name, length, format, print) #format,
+static const char* sequence_opcode_format[] { BYTECODES(BYTECODE_FORMAT) };
+#undef BYTECODE_FORMAT
+#define BYTECODE_PRINT(name, length, format, print) print,
+static const char* sequence_opcode_print[] { BYTECODES(BYTECODE_PRINT) };
+#undef BYTECODE_PRINT
+
+void Interpreter::count_bytecode_sequence(uint8* bcp) {
+  if (pair_counts == null) {
+    pair_counts = unvoid_cast<uint32*>(calloc(OPCODE_COUNT * OPCODE_COUNT, sizeof(uint32)));
+    triple_counts = unvoid_cast<uint32*>(calloc(OPCODE_COUNT * OPCODE_COUNT * OPCODE_COUNT, sizeof(uint32)));
+    if (pair_counts == null || triple_counts == null) FATAL("Cannot allocate bytecode sequence counts");
+  }
+  sequence_dispatches++;
+  int opcode = *bcp;
+  int previous = ILLEGAL_END;
+  // The bytecode after a superinstruction is already fused with it.
+  if (_sequence_bcp != null &&
+      *_sequence_bcp < FIRST_SUPERINSTRUCTION &&
+      _sequence_bcp + sequence_opcode_length[*_sequence_bcp] == bcp) {
+    previous = *_sequence_bcp;
+    pair_counts[previous * OPCODE_COUNT + opcode]++;
+    if (_sequence_previous != ILLEGAL_END) {
+      triple_counts[(_sequence_previous * OPCODE_COUNT + previous) * OPCODE_COUNT + opcode]++;
+    }
+  }
+  _sequence_bcp = bcp;
+  _sequence_previous = previous;
+}
+
+// Keeps the indexes of the largest counts, sorted in descending order.
+class TopSequences {
+ public:
+  static const int SIZE = 25;
+
+  explicit TopSequences(const uint32* counts) : _counts(counts) {}
+
+  void add(int index) {
+    uint32 count = _counts[index];
+    if (count == 0 || (_length == SIZE && count <= _counts[_indexes[SIZE - 1]])) return;
+    int i = _length < SIZE ? _length++ : SIZE - 1;
+    for (; i > 0 && _counts[_indexes[i - 1]] < count; i--) _indexes[i] = _indexes[i - 1];
+    _indexes[i] = index;
+  }
+
+  int length() const { return _length; }
+  int at(int i) const { return _indexes[i]; }
+  uint32 count_at(int i) const { return _counts[_indexes[i]]; }
+
+ private:
+  const uint32* const _counts;
+  int _indexes[SIZE];
+  int _length = 0;
+};
+
+static void print_sequence_percentage(uint32 count) {
+  printf("  %5.2f%% %10u ", count * 100.0 / sequence_dispatches, count);
+}
+
+// Prints a line for the SUPERINSTRUCTIONS list in bytecodes.h.
+static void print_superinstruction_candidate(int first, const char* second, const char* second_print) {
+  if (first >= FIRST_SUPERINSTRUCTION) return;
+  printf("  S(X, %s, %s, %d, %s, \"%s, %s\") \\\n",
+         sequence_opcode_name[first],
+         second,
+         sequence_opcode_length[first],
+         sequence_opcode_format[first],
+         sequence_opcode_print[first],
+         second_print);
+}
+
+void Interpreter::print_bytecode_sequences() {
+  if (pair_counts == null) return;
+  TopSequences pairs(pair_counts);
+  for (int i = 0; i < OPCODE_COUNT * OPCODE_COUNT; i++) pairs.add(i);
+  TopSequences triples(triple_counts);
+  for (int i = 0; i < OPCODE_COUNT * OPCODE_COUNT * OPCODE_COUNT; i++) triples.add(i);
+
+  printf("Bytecode sequences (%llu dispatches)\n", static_cast<unsigned long long>(sequence_dispatches));
+  printf("Pairs:\n");
+  for (int i = 0; i < pairs.length(); i++) {
+    int first = pairs.at(i) / OPCODE_COUNT;
+    int second = pairs.at(i) % OPCODE_COUNT;
+    print_sequence_percentage(pairs.count_at(i));
+    printf("%s %s\n", sequence_opcode_name[first], sequence_opcode_name[second]);
+  }
+  printf("Triples:\n");
+  for (int i = 0; i < triples.length(); i++) {
+    int first = triples.at(i) / (OPCODE_COUNT * OPCODE_COUNT);
+    int second = (triples.at(i) / OPCODE_COUNT) % OPCODE_COUNT;
+    int third = triples.at(i) % OPCODE_COUNT;
+    print_sequence_percentage(triples.count_at(i));
+    printf("%s %s %s\n", sequence_opcode_name[first], sequence_opcode_name[second], sequence_opcode_name[third]);
+  }
+
+  // Triples become a superinstruction for the last two bytecodes, which is
+  // absorbed by another one for the first bytecode.
+  printf("Candidate superinstructions, most frequent first:\n");
+  for (int i = 0; i < pairs.length(); i++) {
+    int first = pairs.at(i) / OPCODE_COUNT;
+    int second = pairs.at(i) % OPCODE_COUNT;
+    print_superinstruction_candidate(first, sequence_opcode_name[second], sequence_opcode_print[second]);
+  }
+  for (int i = 0; i < triples.length(); i++) {
+    int first = triples.at(i) / (OPCODE_COUNT * OPCODE_COUNT);
+    int second = (triples.at(i) / OPCODE_COUNT) % OPCODE_COUNT;
+    int third = triples.at(i) % OPCODE_COUNT;
+    char name[128];
+    char print[128];
+    snprintf(name, sizeof(name), "%s__%s", sequence_opcode_name[second], sequence_opcode_name[third]);
+    snprintf(print, sizeof(print), "%s, %s", sequence_opcode_print[second], sequence_opcode_print[third]);
+    print_superinstruction_candidate(first, name, print);
+  }
+  fflush(stdout);
+}
+
 int Interpreter::compare_numbers(Object* lhs, Object* rhs) {
   int64 lhs_int = 0;
   int64 rhs_int = 0;
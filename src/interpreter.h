@@ -60,6 +60,13 @@ class Interpreter {
   static const int GREATER_EQUAL      = 64;
   static const int STRICTLY_GREATER   = 128;
 
+  // Each slot in the index of a hashed collection holds the position in the
+  // backing shifted left by HASH_INDEX_SHIFT, and the low bits of the hash
+  // code.  64 bit platforms have room for more hash bits.  Coordinate with
+  // HashedInsertionOrderedCollection_ in collections.toit.
+  static const int HASH_INDEX_SHIFT = WORD_SIZE == 8 ? 20 : 12;
+  static const word HASH_INDEX_MASK = (static_cast<word>(1) << HASH_INDEX_SHIFT) - 1;
+
   static int compare_numbers(Object* lhs, Object *rhs);
 
   class Result {
@@ -115,6 +122,10 @@ class Interpreter {
 
   static bool fast_at(Process* process, Object* receiver, Object* args, bool is_put, Object** value);
 
+  // Prints the most frequent bytecode sequences counted with the
+  // bytecode_sequences flag.
+  static void print_bytecode_sequences();
+
  private:
   Object** const PREEMPTION_MARKER = reinterpret_cast<Object**>(UINTPTR_MAX);
 
@@ -125,6 +136,7 @@ class Interpreter {
 #endif
 
   void _trace(uint8* bcp);
+  void count_bytecode_sequence(uint8* bcp);
 
   Method _lookup_entry();
 
@@ -138,6 +150,10 @@ class Interpreter {
   std::atomic<Object**> _watermark;
   bool _in_stack_overflow;
 
+  // The last two bytecodes, for the bytecode_sequences flag.
+  uint8* _sequence_bcp;
+  int _sequence_previous;
+
 #ifdef PROFILER
   bool _is_profiler_active;
   void profile_register_method(Method method);
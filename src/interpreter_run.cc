@@ -90,10 +90,12 @@ Method Program::find_method(Object* receiver, int offset) {
 #ifdef PROFILER
 #define OPCODE_TRACE()                                         \
   if (_is_profiler_active) profile_increment(bcp);             \
-  if (Flags::trace) _trace(bcp);
+  if (Flags::trace) _trace(bcp);                               \
+  if (Flags::bytecode_sequences) count_bytecode_sequence(bcp);
 #else
 #define OPCODE_TRACE()                                         \
-  if (Flags::trace) _trace(bcp);
+  if (Flags::trace) _trace(bcp);                               \
+  if (Flags::bytecode_sequences) count_bytecode_sequence(bcp);
 #endif
 
 // Dispatching helper macros.
@@ -159,6 +161,54 @@ Method Program::find_method(Object* receiver, int offset) {
 #define B_ARG1(name) uint8 name = bcp[1];
 #define S_ARG1(name) uint16 name = *reinterpret_cast<uint16*>(bcp + 1);
 
+// Bodies of the bytecodes that can start a superinstruction.  They must not
+// dispatch, call, or use _length_.
+#define BODY_LOAD_LOCAL_0 { PUSH(STACK_AT(0)); }
+#define BODY_LOAD_LOCAL_1 { PUSH(STACK_AT(1)); }
+#define BODY_LOAD_LOCAL_2 { PUSH(STACK_AT(2)); }
+#define BODY_LOAD_LOCAL_3 { PUSH(STACK_AT(3)); }
+#define BODY_LOAD_LOCAL_4 { PUSH(STACK_AT(4)); }
+#define BODY_LOAD_LOCAL_5 { PUSH(STACK_AT(5)); }
+
+#define BODY_POP_LOAD_LOCAL {                               \
+    B_ARG1(stack_offset);                                   \
+    STACK_AT_PUT(0, STACK_AT(stack_offset + 1));            \
+  }
+
+#define BODY_STORE_LOCAL_POP {                              \
+    B_ARG1(stack_offset);                                   \
+    Object* value = POP();                                  \
+    STACK_AT_PUT(stack_offset - 1, value);                  \
+  }
+
+#define BODY_LOAD_FIELD_LOCAL {                             \
+    B_ARG1(encoded);                                        \
+    int local = encoded & 0x0f;                             \
+    int field = encoded >> 4;                               \
+    Instance* instance = Instance::cast(STACK_AT(local));   \
+    PUSH(instance->at(field));                              \
+  }
+
+#define BODY_LOAD_NULL { PUSH(program->null_object()); }
+#define BODY_LOAD_SMI_0 { PUSH(Smi::from(0)); }
+#define BODY_LOAD_SMI_1 { PUSH(Smi::from(1)); }
+#define BODY_LOAD_SMI_U8 { PUSH(Smi::from(bcp[1])); }
+
+#define BODY_POP_1 {                                        \
+    if (Flags::preemptalot) preempt();                      \
+    POP();                                                  \
+  }
+
+// Superinstructions run the body of their first bytecode and continue with
+// the handler of the second one, which follows in the bytecode stream.
+#define SUPERINSTRUCTION_HANDLER(X, first, second, length, format, print)   \
+  OPCODE_BEGIN(first##__##second);                          \
+    BODY_##first                                            \
+    bcp += _length_;                                        \
+    OPCODE_TRACE()                                          \
+    DISPATCH_TO(second);                                    \
+  }
+
 #ifdef PROFILER
 #define REGISTER_METHOD(target)                             \
   if (_is_profiler_active) profile_register_method(target);
@@ -311,32 +361,31 @@ Interpreter::Result Interpreter::_run() {
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_LOCAL_0);
-    PUSH(STACK_AT(0));
+    BODY_LOAD_LOCAL_0
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_LOCAL_1);
-    PUSH(STACK_AT(1));
+    BODY_LOAD_LOCAL_1
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_LOCAL_2);
-    PUSH(STACK_AT(2));
+    BODY_LOAD_LOCAL_2
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_LOCAL_3);
-    PUSH(STACK_AT(3));
+    BODY_LOAD_LOCAL_3
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_LOCAL_4);
-    PUSH(STACK_AT(4));
+    BODY_LOAD_LOCAL_4
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_LOCAL_5);
-    PUSH(STACK_AT(5));
+    BODY_LOAD_LOCAL_5
   OPCODE_END();
 
   OPCODE_BEGIN(POP_LOAD_LOCAL);
-    B_ARG1(stack_offset);
-    STACK_AT_PUT(0, STACK_AT(stack_offset + 1));
+    BODY_POP_LOAD_LOCAL
   OPCODE_END();
 
   OPCODE_BEGIN(STORE_LOCAL);
@@ -346,9 +395,7 @@ Interpreter::Result Interpreter::_run() {
   OPCODE_END();
 
   OPCODE_BEGIN(STORE_LOCAL_POP);
-    B_ARG1(stack_offset);
-    Object* value = POP();
-    STACK_AT_PUT(stack_offset - 1, value);
+    BODY_STORE_LOCAL_POP
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_OUTER);
@@ -373,11 +420,7 @@ Interpreter::Result Interpreter::_run() {
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_FIELD_LOCAL);
-    B_ARG1(encoded);
-    int local = encoded & 0x0f;
-    int field = encoded >> 4;
-    Instance* instance = Instance::cast(STACK_AT(local));
-    PUSH(instance->at(field));
+    BODY_LOAD_FIELD_LOCAL
   OPCODE_END();
 
   OPCODE_BEGIN(POP_LOAD_FIELD_LOCAL);
@@ -407,11 +450,11 @@ Interpreter::Result Interpreter::_run() {
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_NULL);
-    PUSH(program->null_object());
+    BODY_LOAD_NULL
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_SMI_0);
-    PUSH(Smi::from(0));
+    BODY_LOAD_SMI_0
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_SMIS_0);
@@ -422,11 +465,11 @@ Interpreter::Result Interpreter::_run() {
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_SMI_1);
-    PUSH(Smi::from(1));
+    BODY_LOAD_SMI_1
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_SMI_U8);
-    PUSH(Smi::from(bcp[1]));
+    BODY_LOAD_SMI_U8
   OPCODE_END();
 
   OPCODE_BEGIN(LOAD_SMI_U16);
@@ -498,8 +541,7 @@ Interpreter::Result Interpreter::_run() {
   OPCODE_END();
 
   OPCODE_BEGIN(POP_1);
-    if (Flags::preemptalot) preempt();
-    POP();
+    BODY_POP_1
   OPCODE_END();
 
   OPCODE_BEGIN_WITH_WIDE(ALLOCATE, class_index);
@@ -524,6 +566,7 @@ Interpreter::Result Interpreter::_run() {
         instance->at_put(i, program->null_object());
       }
       PUSH(result);
+      _process->object_heap()->record_allocation_site(bcp);
       if (Flags::gcalot) sp = scavenge(sp, false, 1);
     } else {
       PUSH(Smi::from(class_index));
@@ -1021,6 +1064,7 @@ Interpreter::Result Interpreter::_run() {
 
       // Scavenge might have taken place in object heap but local "method" is from program heap.
       PUSH(result);
+      _process->object_heap()->record_allocation_site(bcp);
       DISPATCH(PRIMITIVE_LENGTH);
 
     done:
@@ -1032,6 +1076,8 @@ Interpreter::Result Interpreter::_run() {
       DROP(arity);
       ASSERT(!is_stack_empty());
       PUSH(result);
+      // Allocations in primitives are attributed to the call site.
+      _process->object_heap()->record_allocation_site(bcp);
       _process->object_heap()->install_heap_limit();
       DISPATCH(0);
     }
@@ -1500,9 +1546,8 @@ Interpreter::Result Interpreter::_run() {
 
     static const int INVALID_SLOT = -1;
 
-    // Coordinate constants with collections.toit.
-    static const int HASH_SHIFT_ = 12;
-    static const int HASH_MASK_ = ((1 << HASH_SHIFT_) - 1);
+    static const int HASH_SHIFT_ = Interpreter::HASH_INDEX_SHIFT;
+    static const word HASH_MASK_ = Interpreter::HASH_INDEX_MASK;
 
     // Either the result of the previously called block or (the first time we
     // run the bytecode) a zero.
@@ -1754,6 +1799,8 @@ Interpreter::Result Interpreter::_run() {
       }
     }  // while(true) loop.
   OPCODE_END();
+
+  SUPERINSTRUCTIONS(SUPERINSTRUCTION_HANDLER, _)
 }
 
 #undef DISPATCH
@@ -0,0 +1,739 @@
+// Copyright (C) 2022 Toitware ApS.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; version
+// 2.1 only.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// The license can be found in the file `LICENSE` in the top level
+// directory of this repository.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "json.h"
+#include "heap.h"
+#include "interpreter.h"
+#include "objects_inline.h"
+#include "process.h"
+#include "utils.h"
+
+namespace toit {
+
+// Must match the Encoder in lib/encoding/json.toit, which uses `stringify 2`.
+static const int DOUBLE_PRECISION = 2;
+
+// Recursion limit for the encoder.  Deeper (or cyclic) structures are left to
+// the Toit encoder.
+#ifdef TOIT_FREERTOS
+static const int MAX_ENCODE_DEPTH = 16;
+#else
+static const int MAX_ENCODE_DEPTH = 256;
+#endif
+
+// Returns a pointer to the first '"' or '\\' in the range, or [end] if there
+// is none.  Sets [has_high_bits] if any byte before the returned position is
+// not ASCII.
+static const uint8* find_string_end(const uint8* p, const uint8* end, bool* has_high_bits) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    int special = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                 _mm_cmpeq_epi8(chunk, backslash)));
+    int high = _mm_movemask_epi8(chunk);
+    if (special != 0) {
+      int index = __builtin_ctz(special);
+      if ((high & ((1 << index) - 1)) != 0) *has_high_bits = true;
+      return p + index;
+    }
+    if (high != 0) *has_high_bits = true;
+    p += 16;
+  }
+#elif defined(__aarch64__)
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  while (end - p >= 16) {
+    uint8x16_t chunk = vld1q_u8(p);
+    uint8x16_t special = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+    // Let the scalar loop find the exact position in this chunk.
+    if (vmaxvq_u8(special) != 0) break;
+    if (vmaxvq_u8(chunk) >= 0x80) *has_high_bits = true;
+    p += 16;
+  }
+#endif
+  for ( ; p < end; p++) {
+    uint8 c = *p;
+    if (c == '"' || c == '\\') return p;
+    if (c >= 0x80) *has_high_bits = true;
+  }
+  return end;
+}
+
+// Returns a pointer to the first byte in the range that must be escaped in a
+// JSON string, or [end] if there is none.
+static const uint8* find_escape(const uint8* p, const uint8* end) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i max_control = _mm_set1_epi8(0x1f);
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // Unsigned c <= 0x1f is the same as min(c, 0x1f) == c.
+    __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, max_control), chunk);
+    int special = _mm_movemask_epi8(_mm_or_si128(control,
+                                                 _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                              _mm_cmpeq_epi8(chunk, backslash))));
+    if (special != 0) return p + __builtin_ctz(special);
+    p += 16;
+  }
+#elif defined(__aarch64__)
+  const uint8x16_t quote = vdupq_n_u8('"');
+  const uint8x16_t backslash = vdupq_n_u8('\\');
+  const uint8x16_t space = vdupq_n_u8(' ');
+  while (end - p >= 16) {
+    uint8x16_t chunk = vld1q_u8(p);
+    uint8x16_t special = vorrq_u8(vcltq_u8(chunk, space),
+                                  vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)));
+    if (vmaxvq_u8(special) != 0) break;
+    p += 16;
+  }
+#endif
+  for ( ; p < end; p++) {
+    uint8 c = *p;
+    if (c < ' ' || c == '"' || c == '\\') return p;
+  }
+  return end;
+}
+
+static inline bool is_whitespace(uint8 c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static inline bool is_digit(uint8 c) {
+  return '0' <= c && c <= '9';
+}
+
+// Characters that the Toit decoder considers part of a number.  See
+// size_of_json_number in primitive_core.cc.
+static inline bool continues_number(uint8 c) {
+  return is_digit(c) || c == '+' || c == '-' || c == '.' || c == 'e' || c == 'E';
+}
+
+static inline int hex_value(uint8 c) {
+  if (is_digit(c)) return c - '0';
+  c |= 0x20;  // Lower case.
+  if ('a' <= c && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// Reads the four hex digits of a \u escape.  Returns -1 if they are invalid.
+static int read_hex4(const uint8* p) {
+  int result = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hex_value(p[i]);
+    if (digit < 0) return -1;
+    result = (result << 4) | digit;
+  }
+  return result;
+}
+
+JsonDecoder::JsonDecoder(Process* process, const uint8* bytes, word length)
+    : _process(process)
+    , _program(process->program())
+    , _position(bytes)
+    , _end(bytes + length) {
+  memset(_string_cache, 0, sizeof(_string_cache));
+}
+
+JsonDecoder::~JsonDecoder() {
+  free(_values);
+  free(_frames);
+  free(_scratch);
+}
+
+Object* JsonDecoder::_bail_out() {
+  if (_error == null) _error = Primitive::mark_as_error(_program->invalid_argument());
+  return null;
+}
+
+Object* JsonDecoder::_malloc_failed() {
+  if (_error == null) _error = Primitive::mark_as_error(_program->malloc_failed());
+  return null;
+}
+
+Object* JsonDecoder::_allocation_failed() {
+  if (_error == null) _error = Primitive::mark_as_error(_program->allocation_failed());
+  return null;
+}
+
+void JsonDecoder::_skip_whitespace() {
+  while (_position < _end && is_whitespace(*_position)) _position++;
+}
+
+bool JsonDecoder::_expect(uint8 c) {
+  _skip_whitespace();
+  if (_position == _end || *_position != c) return false;
+  _position++;
+  return true;
+}
+
+bool JsonDecoder::_push_value(Object* value) {
+  if (_values_length == _values_capacity) {
+    word capacity = Utils::max<word>(32, _values_capacity * 2);
+    void* grown = realloc(_values, capacity * sizeof(Object*));
+    if (grown == null) return false;
+    _values = unvoid_cast<Object**>(grown);
+    _values_capacity = capacity;
+  }
+  _values[_values_length++] = value;
+  return true;
+}
+
+bool JsonDecoder::_push_frame(bool is_map) {
+  if (_frames_length == _frames_capacity) {
+    word capacity = Utils::max<word>(8, _frames_capacity * 2);
+    void* grown = realloc(_frames, capacity * sizeof(Frame));
+    if (grown == null) return false;
+    _frames = unvoid_cast<Frame*>(grown);
+    _frames_capacity = capacity;
+  }
+  _frames[_frames_length].base = _values_length;
+  _frames[_frames_length].is_map = is_map;
+  _frames_length++;
+  return true;
+}
+
+bool JsonDecoder::_ensure_scratch(word capacity) {
+  if (capacity <= _scratch_capacity) return true;
+  capacity = Utils::max(capacity, Utils::max<word>(64, _scratch_capacity * 2));
+  void* grown = realloc(_scratch, capacity);
+  if (grown == null) return false;
+  _scratch = unvoid_cast<uint8*>(grown);
+  _scratch_capacity = capacity;
+  return true;
+}
+
+Object* JsonDecoder::decode() {
+  Object* result = _decode();
+  if (result == null) return _error;
+  return result;
+}
+
+Object* JsonDecoder::_decode() {
+  while (true) {
+    // Decode a single value, or open a container.
+    _skip_whitespace();
+    if (_position == _end) return _bail_out();
+    Object* value = null;
+    switch (*_position) {
+      case '"':
+        value = _decode_string();
+        break;
+      case '{':
+        _position++;
+        if (_expect('}')) {
+          value = _build_map(_values_length);
+          break;
+        }
+        if (!_push_frame(true)) return _malloc_failed();
+        _skip_whitespace();
+        if (_position == _end || *_position != '"') return _bail_out();
+        value = _decode_string();
+        if (value == null) return null;
+        if (!_push_value(value)) return _malloc_failed();
+        if (!_expect(':')) return _bail_out();
+        continue;
+      case '[':
+        _position++;
+        if (_expect(']')) {
+          value = _build_list(_values_length);
+          break;
+        }
+        if (!_push_frame(false)) return _malloc_failed();
+        continue;
+      case 't':
+        value = _decode_literal("true", 4, _program->true_object());
+        break;
+      case 'f':
+        value = _decode_literal("false", 5, _program->false_object());
+        break;
+      case 'n':
+        value = _decode_literal("null", 4, _program->null_object());
+        break;
+      default:
+        if (*_position == '-' || is_digit(*_position)) {
+          value = _decode_number();
+        } else {
+          return _bail_out();
+        }
+        break;
+    }
+    if (value == null) return null;
+
+    // Add the value to the enclosing containers, closing them as needed.
+    while (true) {
+      // Like the Toit decoder we ignore anything after the top-level value.
+      if (_frames_length == 0) return value;
+      if (!_push_value(value)) return _malloc_failed();
+      Frame* frame = &_frames[_frames_length - 1];
+      _skip_whitespace();
+      if (_position == _end) return _bail_out();
+      uint8 c = *_position++;
+      if (c == ',') {
+        if (frame->is_map) {
+          _skip_whitespace();
+          if (_position == _end || *_position != '"') return _bail_out();
+          Object* key = _decode_string();
+          if (key == null) return null;
+          if (!_push_value(key)) return _malloc_failed();
+          if (!_expect(':')) return _bail_out();
+        }
+        break;  // Decode the next value.
+      }
+      if (c != (frame->is_map ? '}' : ']')) return _bail_out();
+      word base = frame->base;
+      value = frame->is_map ? _build_map(base) : _build_list(base);
+      if (value == null) return null;
+      _values_length = base;
+      _frames_length--;
+    }
+  }
+}
+
+Object* JsonDecoder::_decode_literal(const char* literal, word length, Object* value) {
+  if (_end - _position < length || memcmp(_position, literal, length) != 0) return _bail_out();
+  _position += length;
+  return value;
+}
+
+Object* JsonDecoder::_decode_string() {
+  ASSERT(*_position == '"');
+  const uint8* start = _position + 1;
+  bool has_high_bits = false;
+  const uint8* p = find_string_end(start, _end, &has_high_bits);
+  if (p == _end) return _bail_out();
+  if (*p == '\\') return _decode_escaped_string(start, p, has_high_bits);
+  _position = p + 1;
+  return _make_string(start, p - start, has_high_bits);
+}
+
+Object* JsonDecoder::_decode_escaped_string(const uint8* start, const uint8* p, bool has_high_bits) {
+  word length = 0;
+  const uint8* from = start;
+  while (true) {
+    // Copy the unescaped run, plus room for the longest escape (4 bytes).
+    word run = p - from;
+    if (!_ensure_scratch(length + run + 4)) return _malloc_failed();
+    memcpy(_scratch + length, from, run);
+    length += run;
+    if (p == _end) return _bail_out();
+    if (*p == '"') break;
+    ASSERT(*p == '\\');
+    if (_end - p < 2) return _bail_out();
+    uint8 c = p[1];
+    p += 2;
+    switch (c) {
+      case 'b': c = '\b'; break;
+      case 'f': c = '\f'; break;
+      case 'n': c = '\n'; break;
+      case 'r': c = '\r'; break;
+      case 't': c = '\t'; break;
+      case 'u': {
+        if (_end - p < 4) return _bail_out();
+        int code_point = read_hex4(p);
+        if (code_point < 0) return _bail_out();
+        p += 4;
+        if (0xd800 <= code_point && code_point <= 0xdfff) {
+          // Only well-formed surrogate pairs are handled here.
+          if (code_point > 0xdbff || _end - p < 6 || p[0] != '\\' || p[1] != 'u') return _bail_out();
+          int low = read_hex4(p + 2);
+          if (low < 0xdc00 || low > 0xdfff) return _bail_out();
+          p += 6;
+          code_point = 0x10000 + (((code_point & 0x3ff) << 10) | (low & 0x3ff));
+        }
+        uint8* out = _scratch + length;
+        if (code_point < 0x80) {
+          out[0] = code_point;
+          length += 1;
+        } else if (code_point < 0x800) {
+          out[0] = 0xc0 | (code_point >> 6);
+          out[1] = 0x80 | (code_point & 0x3f);
+          length += 2;
+        } else if (code_point < 0x10000) {
+          out[0] = 0xe0 | (code_point >> 12);
+          out[1] = 0x80 | ((code_point >> 6) & 0x3f);
+          out[2] = 0x80 | (code_point & 0x3f);
+          length += 3;
+        } else {
+          out[0] = 0xf0 | (code_point >> 18);
+          out[1] = 0x80 | ((code_point >> 12) & 0x3f);
+          out[2] = 0x80 | ((code_point >> 6) & 0x3f);
+          out[3] = 0x80 | (code_point & 0x3f);
+          length += 4;
+        }
+        from = p;
+        p = find_string_end(p, _end, &has_high_bits);
+        continue;
+      }
+      default:
+        // Like the Toit decoder, any other escaped character stands for itself.
+        if (c >= 0x80) has_high_bits = true;
+        break;
+    }
+    _scratch[length++] = c;
+    from = p;
+    p = find_string_end(p, _end, &has_high_bits);
+  }
+  _position = p + 1;
+  return _make_string(_scratch, length, has_high_bits);
+}
+
+Object* JsonDecoder::_make_string(const uint8* content, word length, bool has_high_bits) {
+  // Invalid UTF-8 is reported by the Toit decoder.
+  if (has_high_bits && !Utils::is_valid_utf_8(content, length)) return _bail_out();
+  const char* chars = char_cast(content);
+  String** cache_entry = null;
+  if (length <= MAX_CACHED_STRING_SIZE) {
+    int hash = String::compute_hash_code_for(chars, length);
+    cache_entry = &_string_cache[hash & (STRING_CACHE_SIZE - 1)];
+    String* cached = *cache_entry;
+    if (cached != null && cached->slow_equals(chars, length)) return cached;
+  }
+  Error* error = null;
+  String* result = _process->allocate_string(chars, length, &error);
+  if (result == null) {
+    if (_error == null) _error = error;
+    return null;
+  }
+  if (cache_entry != null) *cache_entry = result;
+  return result;
+}
+
+Object* JsonDecoder::_decode_number() {
+  const uint8* start = _position;
+  const uint8* p = start;
+  bool is_negative = *p == '-';
+  if (is_negative) p++;
+  if (p == _end || !is_digit(*p)) return _bail_out();
+  // Leading zeros are left to the Toit decoder, through the check for
+  // trailing number characters below.
+  if (*p == '0') {
+    p++;
+  } else {
+    while (p < _end && is_digit(*p)) p++;
+  }
+  const uint8* digits_end = p;
+  bool is_float = false;
+  if (p < _end && *p == '.') {
+    is_float = true;
+    p++;
+    if (p == _end || !is_digit(*p)) return _bail_out();
+    while (p < _end && is_digit(*p)) p++;
+  }
+  if (p < _end && (*p == 'e' || *p == 'E')) {
+    is_float = true;
+    p++;
+    if (p < _end && (*p == '+' || *p == '-')) p++;
+    if (p == _end || !is_digit(*p)) return _bail_out();
+    while (p < _end && is_digit(*p)) p++;
+  }
+  // The Toit decoder would have included these characters in the number.
+  if (p < _end && continues_number(*p)) return _bail_out();
+  _position = p;
+
+  if (is_float) {
+    // The input isn't zero terminated, so copy the number to a buffer for strtod.
+    char buffer[128];
+    word length = p - start;
+    if (length >= static_cast<word>(sizeof(buffer))) return _bail_out();
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    Double* result = _process->object_heap()->allocate_double(strtod(buffer, null));
+    if (result == null) return _allocation_failed();
+    return result;
+  }
+
+  const uint8* digits = start + (is_negative ? 1 : 0);
+  uint64 magnitude = 0;
+  for (const uint8* d = digits; d < digits_end; d++) {
+    uint64 digit = *d - '0';
+    if (magnitude > (UINT64_MAX - digit) / 10) return _bail_out();
+    magnitude = magnitude * 10 + digit;
+  }
+  int64 value;
+  if (is_negative) {
+    if (magnitude > static_cast<uint64>(INT64_MAX) + 1) return _bail_out();
+    value = static_cast<int64>(0 - magnitude);
+  } else {
+    if (magnitude > static_cast<uint64>(INT64_MAX)) return _bail_out();
+    value = static_cast<int64>(magnitude);
+  }
+  if (Smi::is_valid(value)) return Smi::from(static_cast<word>(value));
+  LargeInteger* result = _process->object_heap()->allocate_large_integer(value);
+  if (result == null) return _allocation_failed();
+  return result;
+}
+
+Object* JsonDecoder::_build_list(word base) {
+  word length = _values_length - base;
+  // Bigger lists use a LargeArray_ backing, which is left to the Toit decoder.
+  if (length > Array::max_length()) return _bail_out();
+  ObjectHeap* heap = _process->object_heap();
+  Array* array = heap->allocate_array(length, _program->null_object());
+  if (array == null) return _allocation_failed();
+  for (word i = 0; i < length; i++) array->at_put(i, _values[base + i]);
+  Instance* list = heap->allocate_instance(_program->list_class_id());
+  if (list == null) return _allocation_failed();
+  int fields = list->length(_program->instance_size_for(list));
+  for (int i = 0; i < fields; i++) list->at_put(i, _program->null_object());
+  list->at_put(0, array);
+  list->at_put(1, Smi::from(length));
+  return list;
+}
+
+// Builds the Map the same way the Toit implementation would after inserting
+// the keys one by one: the keys and values are appended to the backing list
+// in order, and the index holds the backing position and the low bits of the
+// hash code for each key.  See HashedInsertionOrderedCollection_.
+Object* JsonDecoder::_build_map(word base) {
+  ObjectHeap* heap = _process->object_heap();
+  Instance* map = heap->allocate_instance(_program->map_class_id());
+  if (map == null) return _allocation_failed();
+  int fields = map->length(_program->instance_size_for(map));
+  for (int i = 0; i < fields; i++) map->at_put(i, _program->null_object());
+  // Field order: size_, index_spaces_left_, index_, backing_.
+  map->at_put(0, Smi::from(0));
+  map->at_put(1, Smi::from(0));
+
+  word backing_length = _values_length - base;
+  word count = backing_length >> 1;
+  if (count == 0) return map;
+
+  // Same sizing as pick_new_index_size_ for [count] entries.
+  word enough = 1 + count + (count >> 3);
+  word index_size = Utils::max<word>(2, Utils::round_up_to_power_of_two(enough + 1));
+  word spaces_left = static_cast<word>(index_size * 0.85);
+  if (spaces_left <= count) spaces_left = count + 1;
+  const int shift = Interpreter::HASH_INDEX_SHIFT;
+  const word mask = Interpreter::HASH_INDEX_MASK;
+  if (backing_length > Array::max_length() ||
+      index_size > Array::max_length() ||
+      backing_length + 1 > (Smi::MAX_SMI_VALUE >> shift)) {
+    return _bail_out();
+  }
+
+  Array* index = heap->allocate_array(index_size, Smi::from(0));
+  if (index == null) return _allocation_failed();
+  Array* backing_array = heap->allocate_array(backing_length, _program->null_object());
+  if (backing_array == null) return _allocation_failed();
+  Instance* backing = heap->allocate_instance(_program->list_class_id());
+  if (backing == null) return _allocation_failed();
+
+  word index_mask = index_size - 1;
+  word append_position = 0;
+  for (word i = base; i < _values_length; i += 2) {
+    String* key = String::cast(_values[i]);
+    Object* value = _values[i + 1];
+    word hash = key->hash_code();
+    word slot = hash & index_mask;
+    word step = 1;
+    while (true) {
+      word entry = Smi::cast(index->at(slot))->value();
+      if (entry == 0) {
+        index->at_put(slot, Smi::from(((append_position + 1) << shift) | (hash & mask)));
+        backing_array->at_put(append_position, key);
+        backing_array->at_put(append_position + 1, value);
+        append_position += 2;
+        break;
+      }
+      word position = (entry >> shift) - 1;
+      if ((entry & mask) == (hash & mask) && key->equals(backing_array->at(position))) {
+        // Later duplicates overwrite the value, but keep the original position.
+        backing_array->at_put(position + 1, value);
+        break;
+      }
+      slot = (slot + step) & index_mask;
+      step++;
+    }
+  }
+
+  int backing_fields = backing->length(_program->instance_size_for(backing));
+  for (int i = 0; i < backing_fields; i++) backing->at_put(i, _program->null_object());
+  backing->at_put(0, backing_array);
+  backing->at_put(1, Smi::from(append_position));
+
+  word size = append_position >> 1;
+  map->at_put(0, Smi::from(size));
+  map->at_put(1, Smi::from(spaces_left - size));
+  map->at_put(2, index);
+  map->at_put(3, backing);
+  return map;
+}
+
+JsonEncoder::JsonEncoder(Process* process)
+    : _process(process)
+    , _program(process->program()) {}
+
+JsonEncoder::~JsonEncoder() {
+  free(_buffer);
+}
+
+Object* JsonEncoder::encode(Object* object) {
+  if (_encode(object, 0)) return null;
+  if (_malloc_failed) return Primitive::mark_as_error(_program->malloc_failed());
+  return Primitive::mark_as_error(_program->invalid_argument());
+}
+
+bool JsonEncoder::_ensure(word extra) {
+  if (_length + extra <= _capacity) return true;
+  word capacity = Utils::max(_length + extra, Utils::max<word>(64, _capacity * 2));
+  void* grown = realloc(_buffer, capacity);
+  if (grown == null) {
+    _malloc_failed = true;
+    return false;
+  }
+  _buffer = unvoid_cast<uint8*>(grown);
+  _capacity = capacity;
+  return true;
+}
+
+bool JsonEncoder::_put(const char* content, word length) {
+  if (!_ensure(length)) return false;
+  memcpy(_buffer + _length, content, length);
+  _length += length;
+  return true;
+}
+
+bool JsonEncoder::_encode(Object* object, int depth) {
+  if (object->is_smi()) return _encode_integer(Smi::cast(object)->value());
+  if (object == _program->null_object()) return _put("null", 4);
+  if (object == _program->true_object()) return _put("true", 4);
+  if (object == _program->false_object()) return _put("false", 5);
+  if (object->is_large_integer()) return _encode_integer(LargeInteger::cast(object)->value());
+  if (object->is_double()) return _encode_double(Double::cast(object)->value());
+  Blob blob;
+  if (object->byte_content(_program, &blob, STRINGS_ONLY)) {
+    return _encode_string(blob.address(), blob.length());
+  }
+  if (depth >= MAX_ENCODE_DEPTH) return false;
+  if (object->is_array()) {
+    Array* array = Array::cast(object);
+    return _encode_list(array, array->length(), depth);
+  }
+  if (!object->is_instance()) return false;
+  Instance* instance = Instance::cast(object);
+  Smi* class_id = instance->class_id();
+  if (class_id == _program->list_class_id()) {
+    // Lists with a LargeArray_ backing are left to the Toit encoder.
+    Object* array = instance->at(0);
+    Object* size = instance->at(1);
+    if (!array->is_array() || !size->is_smi()) return false;
+    return _encode_list(Array::cast(array), Smi::cast(size)->value(), depth);
+  }
+  if (class_id == _program->map_class_id()) return _encode_map(instance, depth);
+  // Other lists and maps, and unsupported objects, are handled by the Toit
+  // encoder.
+  return false;
+}
+
+bool JsonEncoder::_encode_list(Array* array, word length, int depth) {
+  if (length > array->length()) return false;
+  if (!_put('[')) return false;
+  for (word i = 0; i < length; i++) {
+    if (i > 0 && !_put(',')) return false;
+    if (!_encode(array->at(i), depth + 1)) return false;
+  }
+  return _put(']');
+}
+
+bool JsonEncoder::_encode_map(Instance* map, int depth) {
+  if (!_put('{')) return false;
+  Object* backing = map->at(3);
+  if (backing != _program->null_object()) {
+    if (!backing->is_instance() || Instance::cast(backing)->class_id() != _program->list_class_id()) return false;
+    Object* array_object = Instance::cast(backing)->at(0);
+    Object* size_object = Instance::cast(backing)->at(1);
+    if (!array_object->is_array() || !size_object->is_smi()) return false;
+    Array* array = Array::cast(array_object);
+    word size = Smi::cast(size_object)->value();
+    if (size > array->length()) return false;
+    bool first = true;
+    for (word i = 0; i + 1 < size; i += 2) {
+      Object* key = array->at(i);
+      // Deleted entries are replaced by tombstones in the backing.
+      if (key->is_instance() && Instance::cast(key)->class_id() == _program->tombstone_class_id()) continue;
+      Blob blob;
+      if (!key->byte_content(_program, &blob, STRINGS_ONLY)) return false;
+      if (!first && !_put(',')) return false;
+      first = false;
+      if (!_encode_string(blob.address(), blob.length())) return false;
+      if (!_put(':')) return false;
+      if (!_encode(array->at(i + 1), depth + 1)) return false;
+    }
+  }
+  return _put('}');
+}
+
+bool JsonEncoder::_encode_string(const uint8* content, word length) {
+  if (!_ensure(length + 2)) return false;
+  _buffer[_length++] = '"';
+  const uint8* p = content;
+  const uint8* end = content + length;
+  while (true) {
+    const uint8* special = find_escape(p, end);
+    if (!_put(char_cast(p), special - p)) return false;
+    if (special == end) break;
+    uint8 c = *special;
+    p = special + 1;
+    char escape[8];
+    escape[0] = '\\';
+    word escape_length = 2;
+    switch (c) {
+      case '"':  escape[1] = '"'; break;
+      case '\\': escape[1] = '\\'; break;
+      case '\b': escape[1] = 'b'; break;
+      case '\f': escape[1] = 'f'; break;
+      case '\n': escape[1] = 'n'; break;
+      case '\r': escape[1] = 'r'; break;
+      case '\t': escape[1] = 't'; break;
+      default:
+        snprintf(escape, sizeof(escape), "\\u%04x", c);
+        escape_length = 6;
+        break;
+    }
+    if (!_put(escape, escape_length)) return false;
+  }
+  return _put('"');
+}
+
+bool JsonEncoder::_encode_integer(int64 value) {
+  char buffer[24];
+  int length = snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+  return _put(buffer, length);
+}
+
+bool JsonEncoder::_encode_double(double value) {
+  // Matches float.stringify with a precision.  With "%.*lf" the output always
+  // has a '.', unless it is infinite.
+  if (isnan(value)) return _put("nan", 3);
+  char buffer[400];
+  int length = snprintf(buffer, sizeof(buffer), "%.*lf", DOUBLE_PRECISION, value);
+  if (length < 0 || length >= static_cast<int>(sizeof(buffer))) return false;
+  return _put(buffer, length);
+}
+
+} // namespace toit
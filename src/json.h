@@ -0,0 +1,133 @@
+// Copyright (C) 2022 Toitware ApS.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; version
+// 2.1 only.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// The license can be found in the file `LICENSE` in the top level
+// directory of this repository.
+
+#pragma once
+
+#include "top.h"
+
+namespace toit {
+
+// Native versions of the JSON decoder and encoder in lib/encoding/json.toit.
+// They only handle the common, well-formed cases.  For everything else (syntax
+// errors, unsupported objects, edge cases) they return the invalid_argument
+// error, and the library falls back to the Toit implementation, which is the
+// reference for both results and error messages.
+//
+// Neither class can cause a GC, so the objects they allocate are not rooted
+// anywhere while they work.  On allocation failure they return the usual
+// allocation_failed or malloc_failed errors so the primitive is retried
+// after a GC.
+
+class JsonDecoder {
+ public:
+  JsonDecoder(Process* process, const uint8* bytes, word length);
+  ~JsonDecoder();
+
+  // Returns the decoded value, or an error.
+  Object* decode();
+
+ private:
+  struct Frame {
+    word base;    // Index of the first value of this container in _values.
+    bool is_map;  // Maps have keys and values interleaved on the stack.
+  };
+
+  static const int STRING_CACHE_SIZE = 128;
+  static const int MAX_CACHED_STRING_SIZE = 128;
+
+  Process* const _process;
+  Program* const _program;
+  const uint8* _position;
+  const uint8* const _end;
+
+  Object** _values = null;
+  word _values_length = 0;
+  word _values_capacity = 0;
+
+  Frame* _frames = null;
+  word _frames_length = 0;
+  word _frames_capacity = 0;
+
+  // Buffer for strings with escapes.
+  uint8* _scratch = null;
+  word _scratch_capacity = 0;
+
+  // Recently decoded short strings, indexed by their hash code.
+  String* _string_cache[STRING_CACHE_SIZE];
+
+  Object* _error = null;
+
+  // Returns null on failure, with the error in _error.
+  Object* _decode();
+
+  void _skip_whitespace();
+  bool _expect(uint8 c);
+
+  Object* _decode_string();
+  Object* _decode_escaped_string(const uint8* start, const uint8* backslash, bool has_high_bits);
+  Object* _make_string(const uint8* content, word length, bool has_high_bits);
+  Object* _decode_number();
+  Object* _decode_literal(const char* literal, word length, Object* value);
+
+  Object* _build_list(word base);
+  Object* _build_map(word base);
+
+  bool _push_value(Object* value);
+  bool _push_frame(bool is_map);
+  bool _ensure_scratch(word capacity);
+
+  Object* _bail_out();
+  Object* _malloc_failed();
+  Object* _allocation_failed();
+};
+
+class JsonEncoder {
+ public:
+  explicit JsonEncoder(Process* process);
+  ~JsonEncoder();
+
+  // Returns null on success, or an error.  On success the encoded bytes
+  // can be found with [content] and [length].
+  Object* encode(Object* object);
+
+  const uint8* content() const { return _buffer; }
+  word length() const { return _length; }
+
+ private:
+  Process* const _process;
+  Program* const _program;
+
+  uint8* _buffer = null;
+  word _length = 0;
+  word _capacity = 0;
+  bool _malloc_failed = false;
+
+  bool _encode(Object* object, int depth);
+  bool _encode_string(const uint8* content, word length);
+  bool _encode_list(Array* array, word length, int depth);
+  bool _encode_map(Instance* map, int depth);
+  bool _encode_double(double value);
+  bool _encode_integer(int64 value);
+
+  bool _ensure(word extra);
+  bool _put(const char* content, word length);
+  bool _put(uint8 c) {
+    if (!_ensure(1)) return false;
+    _buffer[_length++] = c;
+    return true;
+  }
+};
+
+} // namespace toit
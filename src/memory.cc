@@ -45,10 +45,6 @@ HeapObject* Block::allocate_raw(int byte_size) {
   return null;
 }
 
-Block* Block::from(HeapObject* object) {
-  return reinterpret_cast<Block*>(Utils::round_down(reinterpret_cast<uword>(object), TOIT_PAGE_SIZE));
-}
-
 void Block::wipe() {
   uint8* begin = unvoid_cast<uint8*>(base());
   uint8* end   = unvoid_cast<uint8*>(limit());
@@ -103,6 +99,30 @@ void BlockList::take_blocks(BlockList* list, RawHeap* heap) {
   list->_blocks = BlockLinkedList();
 }
 
+void BlockList::take_old_blocks(BlockList* old_blocks) {
+  BlockList young_blocks;
+  while (auto block = remove_first()) {
+    if (block->is_old()) {
+      old_blocks->append(block);
+    } else {
+      young_blocks.append(block);
+    }
+  }
+  append_blocks(&young_blocks);
+}
+
+void BlockList::append_blocks(BlockList* list) {
+  while (auto block = list->remove_first()) append(block);
+}
+
+word BlockList::old_length() const {
+  word result = 0;
+  for (auto block : _blocks) {
+    if (block->is_old()) result++;
+  }
+  return result;
+}
+
 void BlockList::set_writable(bool value) {
   for (auto block : _blocks) {
     VM::current()->heap_memory()->set_writable(block, value);
@@ -145,6 +165,10 @@ void BlockList::do_pointers(Program* program, PointerCallback* callback) {
 
 HeapMemory::HeapMemory() {
   _memory_mutex = OS::allocate_mutex(0, "Memory mutex");
+  _scavenge_condition = OS::allocate_condition_variable(_memory_mutex);
+#ifdef TOIT_FREERTOS
+  _scavenge_mutex = OS::allocate_mutex(0, "Scavenge mutex");
+#endif
 }
 
 HeapMemory::~HeapMemory() {
@@ -152,15 +176,27 @@ HeapMemory::~HeapMemory() {
   while (Block* block = _free_list.remove_first()) {
     OS::free_block(block);
   }
+  OS::dispose(_scavenge_condition);
   OS::dispose(_memory_mutex);
+#ifdef TOIT_FREERTOS
+  OS::dispose(_scavenge_mutex);
+#endif
 }
 
 Block* HeapMemory::allocate_block_during_scavenge(RawHeap* heap) {
-  ASSERT(OS::is_locked(_memory_mutex));
-  ASSERT(_in_scavenge);
+  Locker scoped(_memory_mutex);
+  ASSERT(_scavenges_in_progress > 0);
   // If we are in a scavenge we take blocks from the free-list, which is used
-  // to reserve memory for GCs.
-  Block* block = _free_list.remove_first();
+  // to reserve memory for GCs.  Once this heap has used up its part of the
+  // reserve, the rest of the free list belongs to the other scavenges.
+  Block* block = null;
+  if (heap->_scavenge_reserve > 0) {
+    block = _free_list.remove_first();
+    heap->_scavenge_reserve--;
+    _reserved_blocks--;
+  } else if (_free_list.length() > _reserved_blocks) {
+    block = _free_list.remove_first();
+  }
   if (!block) {
     // _free_list should always reserve enough blocks for a GC, but we
     // can be unlucky with the packing, and have to allocate more during
@@ -178,15 +214,15 @@ Block* HeapMemory::allocate_block_during_scavenge(RawHeap* heap) {
 
 Block* HeapMemory::allocate_block(RawHeap* heap) {
   Locker scoped(_memory_mutex);
-  ASSERT(!_in_scavenge);
 
   Block* result = null;
 
   // If we will still have enough free blocks to GC the largest heap even after
   // taking one, then take a free block.  Subtract one in case this is the
   // largest heap in which case when this heap grows we will also need a larger
-  // freelist in order to guarantee completion of a scavenge.
-  if (_free_list.length() - 1 > _largest_number_of_blocks_in_a_heap) {
+  // freelist in order to guarantee completion of a scavenge.  Blocks reserved
+  // for the scavenges in progress must also stay on the free list.
+  if (_free_list.length() - 1 > Utils::max(_largest_number_of_blocks_in_a_heap, _reserved_blocks)) {
     result = _free_list.remove_first();
   } else {
     result = OS::allocate_block();
@@ -210,18 +246,33 @@ Block* HeapMemory::allocate_block(RawHeap* heap) {
   return result;
 }
 
+Block* HeapMemory::allocate_large_block(RawHeap* heap, int byte_size) {
+  uword size = Utils::round_up(sizeof(Block) + byte_size, TOIT_PAGE_SIZE);
+  Block* result = null;
+  if (size == TOIT_PAGE_SIZE) {
+    result = allocate_block(heap);
+    if (!result) return null;
+  } else {
+    result = OS::allocate_large_block(size);
+    if (!result) return null;
+    result->_set_process(heap->owner());
+  }
+  result->_top = Utils::address_at(result->base(), byte_size);
+  ASSERT(result->pages() << TOIT_PAGE_SIZE_LOG2 == static_cast<word>(size));
+  return result;
+}
+
 // For the initial block of a new process, the heap has not been created yet.
 // In this case we don't need to worry about reserving space for GC since the
 // new heap cannot be the largest heap in the system.
 Block* HeapMemory::allocate_initial_block() {
   Locker scoped(_memory_mutex);
-  ASSERT(!_in_scavenge);
 
   Block* result = null;
 
   // If we will still have enough free blocks to GC the largest heap even after
   // taking one, then take a free block.
-  if (_free_list.length() > _largest_number_of_blocks_in_a_heap) {
+  if (_free_list.length() > Utils::max(_largest_number_of_blocks_in_a_heap, _reserved_blocks)) {
     result = _free_list.remove_first();
   } else {
     result = OS::allocate_block();
@@ -238,8 +289,8 @@ void HeapMemory::free_unused_block(Block* block) {
 }
 
 void HeapMemory::free_block(Block* block, RawHeap* heap) {
-  ASSERT(OS::is_locked(_memory_mutex));
-  ASSERT(_in_scavenge);
+  Locker scoped(_memory_mutex);
+  ASSERT(_scavenges_in_progress > 0);
   // If the block's owner is null we know it is program space and the memory is
   // read only.  This does not happen on the device.
   if (block->is_program()) {
@@ -247,25 +298,47 @@ void HeapMemory::free_block(Block* block, RawHeap* heap) {
     FATAL("Program memory freed on device");
 #endif
     set_writable(block, true);
-  } else {
-    ASSERT(_in_scavenge);
+  }
+  word pages = block->pages();
+  if (pages > 1) {
+    OS::free_large_block(block, pages << TOIT_PAGE_SIZE_LOG2);
+    return;
   }
   block->_reset();
   _free_list.prepend(block);
 }
 
-void HeapMemory::enter_scavenge(RawHeap* heap) {
-  ASSERT(OS::is_locked(_memory_mutex));
-  _in_scavenge = true;
+void HeapMemory::enter_scavenge(RawHeap* heap, bool reserve) {
+  Locker scoped(_memory_mutex);
+  word needed = reserve ? heap->number_of_blocks() : 0;
+  // Heaps are scavenged in parallel, and they all take their blocks from the
+  // free list.  Only start this scavenge next to the ones in progress if the
+  // free list covers all of them, otherwise wait for them to finish.
+  while (_scavenges_in_progress > 0 && _free_list.length() < _reserved_blocks + needed) {
+    Block* reserved_block = OS::allocate_block();
+    if (reserved_block) {
+      _free_list.prepend(reserved_block);
+    } else {
+      OS::wait(_scavenge_condition);
+    }
+  }
+  _scavenges_in_progress++;
   // We would like to assert that heap->number_of_blocks() <=
   // _free_list.length(), but this is not always the case if a GC ran into
   // fragmentation and the memory use grew during GC, but no extra pages could
   // be allocated.
+  ASSERT(_free_list.length() >= _reserved_blocks);
+  heap->_scavenge_reserve = Utils::min(needed, _free_list.length() - _reserved_blocks);
+  _reserved_blocks += heap->_scavenge_reserve;
 }
 
 void HeapMemory::leave_scavenge(RawHeap* heap) {
-  ASSERT(OS::is_locked(_memory_mutex));
-  ASSERT(_in_scavenge)
+  Locker scoped(_memory_mutex);
+  ASSERT(_scavenges_in_progress > 0);
+  _reserved_blocks -= heap->_scavenge_reserve;
+  heap->_scavenge_reserve = 0;
+  _scavenges_in_progress--;
+  OS::signal_all(_scavenge_condition);
   // Heap should not grow during scavenge, but we can be unlucky with the
   // fragmentation and reordering of objects in a GC.
   while (heap->number_of_blocks() > _free_list.length()) {
@@ -279,6 +352,10 @@ void HeapMemory::leave_scavenge(RawHeap* heap) {
     }
     _free_list.prepend(reserved_block);
   }
+  // The other heaps that are being scavenged change their number of blocks,
+  // so only the last scavenge to finish looks at the sizes of all heaps.  No
+  // new scavenge can start while we hold the lock.
+  if (_scavenges_in_progress > 0) return;
   // If the heap shrank during GC we may be able to free up some reserve
   // memory now.  We don't do this as agressively on Unix because it just
   // churns the memory map.
@@ -339,7 +416,6 @@ void HeapMemory::leave_scavenge(RawHeap* heap) {
   free(block_array);
 #endif
   _largest_number_of_blocks_in_a_heap = new_largest_number_of_blocks_in_a_heap;
-  _in_scavenge = false;
 }
 
 void HeapMemory::set_writable(Block* block, bool value) {
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include "flags.h"
 #include "linked.h"
 #include "top.h"
 #include "utils.h"
@@ -75,18 +76,68 @@ class Block : public BlockLinkedList::Element {
 
   bool is_empty() { return top() == base(); }
 
+  // Generational scavenging support.  Blocks holding objects that have
+  // survived a scavenge are old.  An old block is remembered if the write
+  // barrier has seen a store of a heap object into it since the last
+  // scavenge, or if it contains stacks, which are written without a barrier.
+  bool is_old() const { return (_flags & OLD_FLAG) != 0; }
+  bool is_remembered() const { return (_flags & (REMEMBERED_FLAG | HAS_STACKS_FLAG)) != 0; }
+  void set_old() { _flags |= OLD_FLAG; }
+  void set_has_stacks() { _flags |= HAS_STACKS_FLAG; }
+  void clear_remembered() { _flags &= ~REMEMBERED_FLAG; }
+
+  // Write barrier, called after a heap object has been stored in an object
+  // in this block.  Without generational scavenges nothing reads the
+  // remembered bit, so the barrier only costs a load of the flag.
+  void record_write() {
+    if (Flags::generational && (_flags & OLD_FLAG) != 0) _flags |= REMEMBERED_FLAG;
+  }
+
+  // Large object support.  A large block holds a single big object that is
+  // never moved by the scavenger.  It spans as many pages as the object
+  // needs.  It starts out old and remembered, so minor scavenges scan it as
+  // a root and never free it.  Full scavenges mark it when it is reached, and
+  // scan its object once.
+  bool is_large() const { return (_flags & LARGE_FLAG) != 0; }
+  void set_large() { _flags |= LARGE_FLAG | OLD_FLAG | REMEMBERED_FLAG; }
+  bool is_marked() const { return (_flags & MARKED_FLAG) != 0; }
+  void set_marked() { _flags |= MARKED_FLAG; }
+  bool is_scanned() const { return (_flags & SCANNED_FLAG) != 0; }
+  void set_scanned() { _flags |= SCANNED_FLAG; }
+  void clear_marks() { _flags &= ~(MARKED_FLAG | SCANNED_FLAG); }
+
   // How many bytes are available for payload in one Block?
   static int max_payload_size(int word_size = WORD_SIZE) {
-    ASSERT(sizeof(Block) == 3 * WORD_SIZE);
+    ASSERT(sizeof(Block) == 4 * WORD_SIZE);
     if (word_size == 4) {
-      return TOIT_PAGE_SIZE_32 - 3 * word_size;
+      return TOIT_PAGE_SIZE_32 - 4 * word_size;
     } else {
-      return TOIT_PAGE_SIZE_64 - 3 * word_size;
+      return TOIT_PAGE_SIZE_64 - 4 * word_size;
     }
   }
 
+  // The largest object that fits in a large block.  On devices large objects
+  // stay within one page, since big contiguous allocations would fragment the
+  // small heap.  Bigger arrays are split into arraylets instead.
+  static int max_large_object_size() {
+#ifdef TOIT_FREERTOS
+    return max_payload_size();
+#else
+    return 16 * MB;
+#endif
+  }
+
+  // Number of pages spanned by this block.  Only a large block can span more
+  // than one page, and its object ends in the last one.
+  word pages() const {
+    uword size = reinterpret_cast<uword>(top()) - reinterpret_cast<uword>(this);
+    return Utils::round_up(size, TOIT_PAGE_SIZE) >> TOIT_PAGE_SIZE_LOG2;
+  }
+
   // Returns the memory block that contains the object.
-  static Block* from(HeapObject* object);
+  static Block* from(HeapObject* object) {
+    return reinterpret_cast<Block*>(Utils::round_down(reinterpret_cast<uword>(object), TOIT_PAGE_SIZE));
+  }
 
   // Tells whether this block of memory contains the object.
   bool contains(HeapObject* object);
@@ -109,12 +160,21 @@ class Block : public BlockLinkedList::Element {
   void _reset() {
     _process = null;
     _top = base();
+    _flags = 0;
   }
 
   void wipe();
 
+  static const uword OLD_FLAG = 1 << 0;
+  static const uword REMEMBERED_FLAG = 1 << 1;
+  static const uword HAS_STACKS_FLAG = 1 << 2;
+  static const uword LARGE_FLAG = 1 << 3;
+  static const uword MARKED_FLAG = 1 << 4;
+  static const uword SCANNED_FLAG = 1 << 5;
+
   Process* _process;
   void* _top;
+  uword _flags;
   friend class BlockList;
   friend class Heap;
   friend class HeapMemory;
@@ -162,6 +222,13 @@ class BlockList {
 
   void take_blocks(BlockList* list, RawHeap* heap);
   void free_blocks(RawHeap* heap);
+  // Moves the old blocks of this list to the end of the given list,
+  // preserving their order.
+  void take_old_blocks(BlockList* old_blocks);
+  // Moves all blocks of the given list to the end of this list.
+  void append_blocks(BlockList* list);
+  // Number of old blocks in this list.
+  word old_length() const;
   void discard_blocks();
 
   word length() const { return _length; }
@@ -185,10 +252,16 @@ class HeapMemory {
   // Memory management (MT safe operations)
   Block* allocate_block(RawHeap* heap);
   Block* allocate_initial_block();
+  // Allocates a large block with room for one object of the given size.  A
+  // block that spans more than one page does not come from the free list, and
+  // goes back to the OS when it is freed.
+  Block* allocate_large_block(RawHeap* heap, int byte_size);
   Block* allocate_block_during_scavenge(RawHeap* heap);
   void free_block(Block* block, RawHeap* heap);
   void set_writable(Block* block, bool value);
-  void enter_scavenge(RawHeap* heap);
+  // Unless reserve is false, sets aside free blocks for the scavenge, which
+  // may wait for other scavenges to finish.
+  void enter_scavenge(RawHeap* heap, bool reserve = true);
   void leave_scavenge(RawHeap* heap);
 
   // This is used for the case where we allocated an initial block for a new
@@ -198,13 +271,29 @@ class HeapMemory {
 
   Mutex* mutex() const { return _memory_mutex; }
 
+#ifdef TOIT_FREERTOS
+  // On devices the free list only reserves enough blocks to scavenge one heap
+  // at a time, so scavenges are serialized with this mutex.  Elsewhere heaps
+  // are scavenged in parallel when the free list has room for all of them;
+  // see enter_scavenge.
+  Mutex* scavenge_mutex() const { return _scavenge_mutex; }
+#endif
+
  private:
   HeapMemory();
   ~HeapMemory();
 
   BlockList _free_list;
   Mutex* _memory_mutex;
-  bool _in_scavenge = false;
+#ifdef TOIT_FREERTOS
+  Mutex* _scavenge_mutex;
+#endif
+  // Signalled when a scavenge ends.
+  ConditionVariable* _scavenge_condition;
+  // Number of heaps currently being scavenged, and the free-list blocks set
+  // aside for them.  Guarded by _memory_mutex.
+  int _scavenges_in_progress = 0;
+  word _reserved_blocks = 0;
   word _largest_number_of_blocks_in_a_heap = 0;  // In pages.
 
   friend class VM;
@@ -243,6 +332,10 @@ class RawHeap {
 
  private:
   Process* const _owner;
+  // Free-list blocks set aside for the scavenge of this heap that is in
+  // progress.  Guarded by the heap memory mutex.
+  word _scavenge_reserve = 0;
+  friend class HeapMemory;
   friend class ImageAllocator;
   friend class Program;
 };
@@ -35,7 +35,11 @@ bool Object::byte_content(Program* program, const uint8** content, int* length,
     ByteArray* byte_array = ByteArray::cast(this);
     // External byte arrays can have structs in them. This is captured in the external tag.
     // We only allow extracting the byte content from an external byte arrays iff it is tagged with RawByteType.
-    if (byte_array->has_external_address() && byte_array->external_tag() != RawByteTag) return false;
+    if (byte_array->has_external_address() &&
+        byte_array->external_tag() != RawByteTag &&
+        !byte_array->has_shared_content()) {
+      return false;
+    }
     ByteArray::Bytes bytes(byte_array);
     *length = bytes.length();
     *content = bytes.address();
@@ -297,6 +301,21 @@ int Stack::frames_do(Program* program, FrameCallback* cb) {
   return frame_no;
 }
 
+int Stack::active_bcis(Program* program, int32* bcis, int max_bcis) {
+  int stack_length = _stack_base_addr() - _stack_sp_addr();
+  int count = 0;
+  // The bcp that goes with the bottom-most frame marker doesn't belong to
+  // a user frame, so we only record a bcp when we see the next marker.
+  uint8* last_bcp = null;
+  for (int index = 0; index < stack_length - 1 && count < max_bcis; index++) {
+    Object* probe = at(index);
+    if (probe != program->frame_marker()) continue;
+    if (last_bcp != null) bcis[count++] = program->absolute_bci_from_bcp(last_bcp);
+    last_bcp = reinterpret_cast<uint8*>(at(index + 1));
+  }
+  return count;
+}
+
 void Stack::copy_to(HeapObject* other, int other_length) {
   other->_at_put(HeapObject::HEADER_OFFSET, _at(HeapObject::HEADER_OFFSET));
   Stack* to = Stack::cast(other);
@@ -376,27 +395,61 @@ bool String::starts_with_vowel() {
   return strchr("aeiouAEIOU", bytes.at(pos)) != null;
 }
 
-int16 String::compute_hash_code() {
+half_word String::compute_hash_code() {
   Bytes bytes(this);
   return compute_hash_code_for(reinterpret_cast<const char*>(bytes.address()), bytes.length());
 }
 
-int16 String::compute_hash_code_for(const char* str) {
+half_word String::compute_hash_code_for(const char* str) {
   return compute_hash_code_for(str, strlen(str));
 }
 
-int16 String::compute_hash_code_for(const char* str, int str_len) {
-  // Trivial computation of hash code for string.
-  int16 hash = str_len;
-  for (int index = 0; index < str_len; index++) {
-    // The sign of 'char' is implementation dependent.
-    // Force the value to be signed to have a deterministic hash.
-    hash = 31 * hash + static_cast<int8>(str[index]);
+static inline uint32 rotate_left(uint32 value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+half_word String::compute_hash_code_for(const char* str, int str_len) {
+  // MurmurHash3 (x86, 32 bit) with a zero seed.  It consumes four bytes at a
+  // time, so it is fast on long strings, and all the output bits are well
+  // mixed, so the low bits can be used directly to index hash tables.  On 32
+  // bit platforms only the low half of the result is kept.
+  const uint8* bytes = reinterpret_cast<const uint8*>(str);
+  const uint32 c1 = 0xcc9e2d51;
+  const uint32 c2 = 0x1b873593;
+  uint32 hash = 0;
+  int index = 0;
+  for ( ; index + 4 <= str_len; index += 4) {
+    uint32 k;
+    memcpy(&k, bytes + index, sizeof(k));
+    k *= c1;
+    k = rotate_left(k, 15);
+    k *= c2;
+    hash ^= k;
+    hash = rotate_left(hash, 13);
+    hash = hash * 5 + 0xe6546b64;
+  }
+  uint32 k = 0;
+  switch (str_len & 3) {
+    case 3: k ^= bytes[index + 2] << 16;  // Fall through.
+    case 2: k ^= bytes[index + 1] << 8;   // Fall through.
+    case 1:
+      k ^= bytes[index];
+      k *= c1;
+      k = rotate_left(k, 15);
+      k *= c2;
+      hash ^= k;
   }
-  return hash != NO_HASH_CODE ? hash : 0;
+  hash ^= str_len;
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  half_word result = static_cast<half_word>(hash);
+  return result != NO_HASH_CODE ? result : 0;
 }
 
-int16 String::_assign_hash_code() {
+half_word String::_assign_hash_code() {
   _raw_set_hash_code(compute_hash_code());
   ASSERT(_raw_hash_code() != NO_HASH_CODE);
   ASSERT(_is_valid_utf8());
@@ -452,7 +505,7 @@ void Array::write_content(SnapshotWriter* st) {
 void ByteArray::write_content(SnapshotWriter* st) {
   Bytes bytes(this);
   if (bytes.length() > SNAPSHOT_INTERNAL_SIZE_CUTOFF) {
-    if (has_external_address() && external_tag() != RawByteTag) {
+    if (has_external_address() && external_tag() != RawByteTag && !has_shared_content()) {
       FATAL("Can only serialize raw bytes");
     }
     st->write_external_list_uint8(List<uint8>(bytes.address(), bytes.length()));
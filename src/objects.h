@@ -204,6 +204,12 @@ class HeapObject : public Object {
     return _at(HEADER_OFFSET);
   }
 
+  // Write barrier for generational scavenges.  Must be called after storing
+  // a heap object in one of the fields of this object.
+  INLINE void record_write() {
+    Block::from(this)->record_write();
+  }
+
   // Pseudo virtual member functions.
   int size(Program* program);  // Returns the byte size of this object.
   void roots_do(Program* program, RootCallback* cb);
@@ -322,10 +328,12 @@ class Array : public HeapObject {
   INLINE void at_put(int index, Object* value) {
     ASSERT(index >= 0 && index < length());
     _at_put(_offset_from(index), value);
+    if (value->is_heap_object()) record_write();
   }
 
   void copy_from(Array* other, int length) {
     memcpy(content(), other->content(), length * WORD_SIZE);
+    record_write();
   }
 
   uint8* content() { return reinterpret_cast<uint8*>(_raw() + _offset_from(0)); }
@@ -429,7 +437,7 @@ class ByteArray : public HeapObject {
   }
 
   uint8* as_external() {
-    ASSERT(external_tag() == RawByteTag || external_tag() == NullStructTag);
+    ASSERT(external_tag() == RawByteTag || external_tag() == NullStructTag || has_shared_content());
     if (has_external_address()) return unsigned_cast(_external_address());
     return 0;
   }
@@ -493,6 +501,13 @@ class ByteArray : public HeapObject {
 
   uint8* neuter(Process* process);
 
+  // Whether the content is a read-only SharedBuffer.
+  bool has_shared_content() {
+    if (!has_external_address()) return false;
+    word tag = external_tag();
+    return tag == SharedBufferTag || tag == SharedBufferOwnerTag;
+  }
+
   word external_tag() {
     ASSERT(has_external_address());
     return _word_at(EXTERNAL_TAG_OFFSET);
@@ -634,6 +649,11 @@ class Stack : public HeapObject {
   // Iterates over all frames on this stack and returns the number of frames.
   int frames_do(Program* program, FrameCallback* cb);
 
+  // Stores the absolute bcis of the frames on a suspended stack in [bcis],
+  // innermost first, and returns the number of bcis stored.  At most
+  // [max_bcis] are stored; the outermost frames are dropped.
+  int active_bcis(Program* program, int32* bcis, int max_bcis);
+
   static INLINE int initial_length() { return 64; }
   static INLINE int max_length();
 
@@ -731,8 +751,8 @@ class Double : public HeapObject {
 
 class String : public HeapObject {
  public:
-  int16 hash_code() {
-    int result = _raw_hash_code();
+  half_word hash_code() {
+    half_word result = _raw_hash_code();
     return result != NO_HASH_CODE ? result : _assign_hash_code();
   }
 
@@ -794,9 +814,9 @@ class String : public HeapObject {
                    length_b);
   }
 
-  int16 compute_hash_code();
-  static int16 compute_hash_code_for(const char* str, int str_len);
-  static int16 compute_hash_code_for(const char* str);
+  half_word compute_hash_code();
+  static half_word compute_hash_code_for(const char* str, int str_len);
+  static half_word compute_hash_code_for(const char* str);
 
   void write_content(SnapshotWriter* st);
   void read_content(SnapshotReader* st, int length);
@@ -912,13 +932,13 @@ class String : public HeapObject {
   // in heap content:  [class:w][hash_code:h][length:h][content:byte*length][0][padding]
   // off heap content: [class:w][hash_code:h][-1:h]    [length:w][external_address:w]
   // The first length field will also be used or tagging, recognizing an external representation.
-  // Please note that if need be it is easy to extend the width of hash_code for strings with off heap content.
+  // The hash code uses the full half word: 32 bits on 64 bit platforms and 16 bits on 32 bit platforms.
   static const int SENTINEL = 65535;
   static const int HASH_CODE_OFFSET = HeapObject::SIZE;
   static const int INTERNAL_LENGTH_OFFSET = HASH_CODE_OFFSET + HALF_WORD_SIZE;
   static const int INTERNAL_HEADER_SIZE = INTERNAL_LENGTH_OFFSET + HALF_WORD_SIZE;
   static const word OVERHEAD = INTERNAL_HEADER_SIZE + 1;
-  static const int16 NO_HASH_CODE = -1;
+  static const half_word NO_HASH_CODE = -1;
 
   static const int EXTERNAL_LENGTH_OFFSET = INTERNAL_HEADER_SIZE;
   static const int EXTERNAL_ADDRESS_OFFSET = EXTERNAL_LENGTH_OFFSET + WORD_SIZE;
@@ -928,8 +948,8 @@ class String : public HeapObject {
   // Any string that is bigger than this size is snapshotted as external string.
   static const int SNAPSHOT_INTERNAL_SIZE_CUTOFF = TOIT_PAGE_SIZE_32 >> 2;
 
-  int16 _raw_hash_code() { return _half_word_at(HASH_CODE_OFFSET); }
-  void _raw_set_hash_code(int16 value) { _half_word_at_put(HASH_CODE_OFFSET, value); }
+  half_word _raw_hash_code() { return _half_word_at(HASH_CODE_OFFSET); }
+  void _raw_set_hash_code(half_word value) { _half_word_at_put(HASH_CODE_OFFSET, value); }
   void _set_length(int value) { _half_word_at_put(INTERNAL_LENGTH_OFFSET, value); }
 
   static int _offset_from(int index) {
@@ -939,7 +959,7 @@ class String : public HeapObject {
     ASSERT(index <= max_internal_size() + 1);
     return INTERNAL_HEADER_SIZE + index;
   }
-  int16 _assign_hash_code();
+  half_word _assign_hash_code();
 
   uint8* _as_utf8bytes() {
     if (content_on_heap()) {
@@ -1115,6 +1135,7 @@ class Instance : public HeapObject {
 
   void at_put(int index, Object* value) {
     _at_put(_offset_from(index), value);
+    if (value->is_heap_object()) record_write();
   }
 
   void roots_do(int instance_size, RootCallback* cb);
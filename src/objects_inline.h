@@ -38,7 +38,7 @@ inline Process* HeapObject::owner() {
 
 
 inline int Array::max_length() {
-  return (Block::max_payload_size() - HEADER_SIZE) / WORD_SIZE;
+  return (Block::max_large_object_size() - HEADER_SIZE) / WORD_SIZE;
 }
 
 inline int Stack::max_length() {
@@ -82,6 +82,7 @@ class Thread {
   static void ensure_system_thread();
 
   // Returns true for success, false for malloc failure.
+  // On hosts, the stack size is only used if it is larger than the default.
   bool spawn(int stack_size = 0, int core = -1);
   void run();  // Run on current thread.
 
@@ -210,6 +211,10 @@ class OS {
 
   static Block* allocate_block();
   static void free_block(Block* block);
+  // A large block holds a single object and spans [size] bytes, a multiple
+  // of TOIT_PAGE_SIZE.  It is aligned like a normal block.
+  static Block* allocate_large_block(uword size);
+  static void free_large_block(Block* block, uword size);
   static void set_writable(Block* block, bool value);
 
   static void set_up();
@@ -39,16 +39,12 @@ int OS::num_cores() {
 }
 
 
-void OS::free_block(Block* block) {
-  int result = munmap(void_cast(block), TOIT_PAGE_SIZE);
-  USE(result);
-  ASSERT(result == 0);
-}
-
-Block* OS::allocate_block() {
+// Maps [size] bytes aligned to TOIT_PAGE_SIZE, by mapping an extra page and
+// unmapping the parts before and after the aligned range.
+static void* map_aligned(uword size) {
 #if BUILD_64
-  uword size = TOIT_PAGE_SIZE * 2;
-  void* result = mmap(null, size,
+  uword mapped_size = size + TOIT_PAGE_SIZE;
+  void* result = mmap(null, mapped_size,
        PROT_READ | PROT_WRITE,
        MAP_PRIVATE | MAP_ANON, -1, 0);
   if (result == MAP_FAILED) return null;
@@ -60,23 +56,45 @@ Block* OS::allocate_block() {
     USE(unmap_result);
     ASSERT(unmap_result == 0);
   }
-  if (aligned + TOIT_PAGE_SIZE != addr + size) {
+  if (aligned + size != addr + mapped_size) {
     // Unmap the part at the end that we can't use because of alignment.
-    int unmap_result = munmap(reinterpret_cast<void*>(aligned + TOIT_PAGE_SIZE), addr + size - aligned - TOIT_PAGE_SIZE);
+    int unmap_result = munmap(reinterpret_cast<void*>(aligned + size), addr + mapped_size - aligned - size);
     USE(unmap_result);
     ASSERT(unmap_result == 0);
   }
-  return new (reinterpret_cast<void*>(aligned)) Block();
+  return reinterpret_cast<void*>(aligned);
 #else
   // Using 4k pages on 32 bit we know that the result of mmap will always be
   // page aligned.
-  void* result = mmap(null, TOIT_PAGE_SIZE,
+  void* result = mmap(null, size,
        PROT_READ | PROT_WRITE,
        MAP_PRIVATE | MAP_ANON, -1, 0);
-  return (result == MAP_FAILED) ? null : new (result) Block();
+  return (result == MAP_FAILED) ? null : result;
 #endif
 }
 
+void OS::free_block(Block* block) {
+  int result = munmap(void_cast(block), TOIT_PAGE_SIZE);
+  USE(result);
+  ASSERT(result == 0);
+}
+
+Block* OS::allocate_block() {
+  void* result = map_aligned(TOIT_PAGE_SIZE);
+  return (result == null) ? null : new (result) Block();
+}
+
+Block* OS::allocate_large_block(uword size) {
+  void* result = map_aligned(size);
+  return (result == null) ? null : new (result) Block();
+}
+
+void OS::free_large_block(Block* block, uword size) {
+  int result = munmap(void_cast(block), size);
+  USE(result);
+  ASSERT(result == 0);
+}
+
 void OS::set_writable(Block* block, bool value) {
   mprotect(void_cast(block), TOIT_PAGE_SIZE, PROT_READ | (value ? PROT_WRITE : 0));
 }
@@ -342,6 +342,18 @@ Block* OS::allocate_block() {
   return new (allocation) Block();
 }
 
+Block* OS::allocate_large_block(uword size) {
+  HeapTagScope scope(ITERATE_CUSTOM_TAGS + TOIT_HEAP_MALLOC_TAG);
+  void* allocation = heap_caps_aligned_alloc(TOIT_PAGE_SIZE, size, MALLOC_CAP_8BIT | MALLOC_CAP_DEFAULT);
+  if (allocation == null) return null;
+  ASSERT(Utils::is_aligned(reinterpret_cast<intptr_t>(allocation), TOIT_PAGE_SIZE));
+  return new (allocation) Block();
+}
+
+void OS::free_large_block(Block* block, uword size) {
+  heap_caps_free(reinterpret_cast<void*>(block));
+}
+
 void OS::set_writable(Block* block, bool value) {
   // Not supported on ESP32.
 }
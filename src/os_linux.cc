@@ -24,6 +24,7 @@
 #include <time.h>
 #include <errno.h>
 #include <pthread.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/sysinfo.h>
 #include <unistd.h>
@@ -34,16 +35,146 @@ int OS::num_cores() {
   return get_nprocs();
 }
 
-void OS::free_block(Block* block) {
-  int result = munmap(void_cast(block), TOIT_PAGE_SIZE);
-  USE(result);
-  ASSERT(result == 0);
+#if BUILD_64
+
+// On 64 bit Linux, heap blocks are handed out from one large reservation of
+// address space, instead of mapping and unmapping each block.  Memory is made
+// accessible in huge-page sized chunks as the arena grows.  Freed blocks are
+// released to the kernel with madvise, but stay in the arena for reuse, so a
+// busy heap does not churn the memory map.  If the arena can't be reserved,
+// or is full, we fall back to mapping individual blocks.
+class BlockArena {
+ public:
+  bool contains(void* address) const {
+    uword value = reinterpret_cast<uword>(address);
+    return _start <= value && value < _end;
+  }
+
+  // Returns null if the arena is not available or full.
+  void* allocate();
+  void release(void* address);
+
+ private:
+  // Huge pages are 2MB on the common platforms.
+  static const uword CHUNK_SIZE = 2 * MB;
+
+  bool ensure_reserved();
+  bool ensure_free_capacity();
+
+  pthread_mutex_t _mutex = PTHREAD_MUTEX_INITIALIZER;
+  bool _initialized = false;
+  bool _explicit_huge_pages = false;
+  uword _start = 0;
+  uword _end = 0;
+  uword _top = 0;        // Blocks below this have been handed out before.
+  uword _committed = 0;  // Memory below this is readable and writable.
+  // Indices of the released blocks.  Has room for all blocks below _top, so
+  // freeing a block never needs to allocate.
+  uint32* _free_indices = null;
+  word _free_count = 0;
+  word _free_capacity = 0;
+};
+
+static BlockArena block_arena;
+
+bool BlockArena::ensure_reserved() {
+  if (_initialized) return _start != 0;
+  _initialized = true;
+  if (Flags::heap_arena_mb <= 0) return false;
+  uword size = Utils::round_up(static_cast<uword>(Flags::heap_arena_mb) * MB, CHUNK_SIZE);
+  const char* huge_pages = Flags::huge_pages;
+  void* result = MAP_FAILED;
+  if (huge_pages != null && strcmp(huge_pages, "explicit") == 0) {
+    // Explicit huge pages are reserved up front from the pool configured in
+    // /proc/sys/vm/nr_hugepages, and are never released.
+    result = mmap(null, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
+    if (result != MAP_FAILED) {
+      _explicit_huge_pages = true;
+      _start = reinterpret_cast<uword>(result);
+      _end = _committed = _start + size;
+      _top = _start;
+      return true;
+    }
+    // Fall back to a normal arena.
+  }
+  // Reserve the address space without committing any memory.  The extra
+  // chunk lets us align the arena to huge pages.
+  result = mmap(null, size + CHUNK_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+  if (result == MAP_FAILED) return false;
+  uword addr = reinterpret_cast<uword>(result);
+  uword aligned = Utils::round_up(addr, CHUNK_SIZE);
+  if (aligned != addr) munmap(result, aligned - addr);
+  if (aligned + size != addr + size + CHUNK_SIZE) {
+    munmap(reinterpret_cast<void*>(aligned + size), addr + CHUNK_SIZE - aligned);
+  }
+  if (huge_pages != null && strcmp(huge_pages, "transparent") == 0) {
+    madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+  }
+  _start = _top = _committed = aligned;
+  _end = aligned + size;
+  return true;
 }
 
-Block* OS::allocate_block() {
+bool BlockArena::ensure_free_capacity() {
+  word blocks = (_top - _start) / TOIT_PAGE_SIZE + 1;
+  if (blocks <= _free_capacity) return true;
+  word new_capacity = Utils::max(static_cast<word>(1024), _free_capacity * 2);
+  void* indices = realloc(_free_indices, new_capacity * sizeof(uint32));
+  if (indices == null) return false;
+  _free_indices = unvoid_cast<uint32*>(indices);
+  _free_capacity = new_capacity;
+  return true;
+}
+
+void* BlockArena::allocate() {
+  pthread_mutex_lock(&_mutex);
+  void* result = null;
+  if (!ensure_reserved()) {
+    // No arena.
+  } else if (_free_count > 0) {
+    uword index = _free_indices[--_free_count];
+    result = reinterpret_cast<void*>(_start + index * TOIT_PAGE_SIZE);
+  } else if (_top + TOIT_PAGE_SIZE <= _end && ensure_free_capacity()) {
+    if (_top + TOIT_PAGE_SIZE > _committed) {
+      uword chunk_end = Utils::min(_committed + CHUNK_SIZE, _end);
+      if (mprotect(reinterpret_cast<void*>(_committed), chunk_end - _committed, PROT_READ | PROT_WRITE) == 0) {
+        _committed = chunk_end;
+      }
+    }
+    if (_top + TOIT_PAGE_SIZE <= _committed) {
+      result = reinterpret_cast<void*>(_top);
+      _top += TOIT_PAGE_SIZE;
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+  return result;
+}
+
+void BlockArena::release(void* address) {
+  // Released memory reads as zeros when it is touched again, just like a
+  // fresh mapping.  Explicit huge pages can't be released in block sized
+  // pieces, so we clear them ourselves.
+  if (_explicit_huge_pages) {
+    memset(address, 0, TOIT_PAGE_SIZE);
+  } else {
+    int result = madvise(address, TOIT_PAGE_SIZE, MADV_DONTNEED);
+    USE(result);
+    ASSERT(result == 0);
+  }
+  pthread_mutex_lock(&_mutex);
+  ASSERT(_free_count < _free_capacity);
+  _free_indices[_free_count++] = (reinterpret_cast<uword>(address) - _start) / TOIT_PAGE_SIZE;
+  pthread_mutex_unlock(&_mutex);
+}
+
+#endif  // BUILD_64
+
+// Maps [size] bytes aligned to TOIT_PAGE_SIZE, by mapping an extra page and
+// unmapping the parts before and after the aligned range.
+static void* map_aligned(uword size) {
 #if BUILD_64
-  uword size = TOIT_PAGE_SIZE * 2;
-  void* result = mmap(null, size,
+  uword mapped_size = size + TOIT_PAGE_SIZE;
+  void* result = mmap(null, mapped_size,
        PROT_READ | PROT_WRITE,
        MAP_PRIVATE | MAP_ANON, -1, 0);
   if (result == MAP_FAILED) return null;
@@ -55,21 +186,53 @@ Block* OS::allocate_block() {
     USE(unmap_result);
     ASSERT(unmap_result == 0);
   }
-  if (aligned + TOIT_PAGE_SIZE != addr + size) {
+  if (aligned + size != addr + mapped_size) {
     // Unmap the part at the end that we can't use because of alignment.
-    int unmap_result = munmap(reinterpret_cast<void*>(aligned + TOIT_PAGE_SIZE), addr + size - aligned - TOIT_PAGE_SIZE);
+    int unmap_result = munmap(reinterpret_cast<void*>(aligned + size), addr + mapped_size - aligned - size);
     USE(unmap_result);
     ASSERT(unmap_result == 0);
   }
-  return new (reinterpret_cast<void*>(aligned)) Block();
+  return reinterpret_cast<void*>(aligned);
 #else
   // Using 4k pages on 32 bit we know that the result of mmap will always be
   // page aligned.
-  void* result = mmap(null, TOIT_PAGE_SIZE,
+  void* result = mmap(null, size,
        PROT_READ | PROT_WRITE,
        MAP_PRIVATE | MAP_ANON, -1, 0);
-  return (result == MAP_FAILED) ? null : new (result) Block();
+  return (result == MAP_FAILED) ? null : result;
+#endif
+}
+
+void OS::free_block(Block* block) {
+#if BUILD_64
+  if (block_arena.contains(block)) {
+    block_arena.release(block);
+    return;
+  }
+#endif
+  int result = munmap(void_cast(block), TOIT_PAGE_SIZE);
+  USE(result);
+  ASSERT(result == 0);
+}
+
+Block* OS::allocate_block() {
+#if BUILD_64
+  void* arena_block = block_arena.allocate();
+  if (arena_block != null) return new (arena_block) Block();
 #endif
+  void* result = map_aligned(TOIT_PAGE_SIZE);
+  return (result == null) ? null : new (result) Block();
+}
+
+Block* OS::allocate_large_block(uword size) {
+  void* result = map_aligned(size);
+  return (result == null) ? null : new (result) Block();
+}
+
+void OS::free_large_block(Block* block, uword size) {
+  int result = munmap(void_cast(block), size);
+  USE(result);
+  ASSERT(result == 0);
 }
 
 void OS::set_writable(Block* block, bool value) {
@@ -190,7 +190,20 @@ void Thread::_boot() {
 }
 
 bool Thread::spawn(int stack_size, int core) {
-  int result = pthread_create(reinterpret_cast<pthread_t*>(&_handle), null, &thread_start, void_cast(this));
+  pthread_attr_t attributes;
+  int result = pthread_attr_init(&attributes);
+  if (result != 0) FATAL("pthread_attr_init failed");
+  // Most requested stack sizes are tuned for the ESP32 and are far too small
+  // for a host, so only use them to ask for more than the default.
+  size_t default_stack_size;
+  result = pthread_attr_getstacksize(&attributes, &default_stack_size);
+  if (result != 0) FATAL("pthread_attr_getstacksize failed");
+  if (stack_size > 0 && static_cast<size_t>(stack_size) > default_stack_size) {
+    result = pthread_attr_setstacksize(&attributes, stack_size);
+    if (result != 0) FATAL("pthread_attr_setstacksize failed");
+  }
+  result = pthread_create(reinterpret_cast<pthread_t*>(&_handle), &attributes, &thread_start, void_cast(this));
+  pthread_attr_destroy(&attributes);
   if (result != 0) {
     FATAL("pthread_create failed");
   }
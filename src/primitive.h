@@ -229,6 +229,20 @@ namespace toit {
   PRIMITIVE(varint_encode, 3)                \
   PRIMITIVE(varint_decode, 2)                \
   PRIMITIVE(literal_index, 1)                \
+  PRIMITIVE(set_process_priority, 2)         \
+  PRIMITIVE(sampling_profiler_install, 0)    \
+  PRIMITIVE(sampling_profiler_start, 0)      \
+  PRIMITIVE(sampling_profiler_stop, 0)       \
+  PRIMITIVE(sampling_profiler_encode, 1)     \
+  PRIMITIVE(sampling_profiler_uninstall, 0)  \
+  PRIMITIVE(allocation_profiler_install, 1)  \
+  PRIMITIVE(allocation_profiler_encode, 1)   \
+  PRIMITIVE(allocation_profiler_uninstall, 0) \
+  PRIMITIVE(byte_array_new_shared, 1)        \
+  PRIMITIVE(json_decode, 1)                  \
+  PRIMITIVE(json_encode, 2)                  \
+  PRIMITIVE(hash_index_shift, 0)             \
+  PRIMITIVE(gc_stats, 0)                     \
 
 #define MODULE_TIMER(PRIMITIVE)              \
   PRIMITIVE(init, 0)                         \
@@ -248,6 +262,8 @@ namespace toit {
   PRIMITIVE(error, 1)                        \
   PRIMITIVE(get_option, 3)                   \
   PRIMITIVE(set_option, 4)                   \
+  PRIMITIVE(read_into, 5)                    \
+  PRIMITIVE(write_vector, 3)                 \
 
 #define MODULE_UDP(PRIMITIVE)                \
   PRIMITIVE(init, 0)                         \
@@ -259,6 +275,8 @@ namespace toit {
   PRIMITIVE(set_option, 4)                   \
   PRIMITIVE(error, 1)                        \
   PRIMITIVE(close, 2)                        \
+  PRIMITIVE(send_batch, 5)                   \
+  PRIMITIVE(receive_batch, 4)                \
 
 #define MODULE_TLS(PRIMITIVE)                \
   PRIMITIVE(init, 1)                         \
@@ -278,11 +296,14 @@ namespace toit {
   PRIMITIVE(error, 2)                        \
   PRIMITIVE(get_session, 1)                  \
   PRIMITIVE(set_session, 2)                  \
+  PRIMITIVE(handshake_stats, 0)              \
+  PRIMITIVE(set_direct_fd, 2)                \
 
 #define MODULE_DNS(PRIMITIVE)                \
   PRIMITIVE(init, 0)                         \
   PRIMITIVE(lookup, 2)                       \
   PRIMITIVE(lookup_result, 2)                \
+  PRIMITIVE(lookup_all_result, 2)            \
 
 #define MODULE_WIFI(PRIMITIVE)               \
   PRIMITIVE(init, 0)                         \
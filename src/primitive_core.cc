@@ -17,6 +17,7 @@
 #include "entropy_mixer.h"
 #include "heap.h"
 #include "heap_report.h"
+#include "json.h"
 #include "objects_inline.h"
 #include "os.h"
 #include "primitive.h"
@@ -909,7 +910,7 @@ PRIMITIVE(bytes_allocated_delta) {
 
 PRIMITIVE(process_stats) {
   ARGS(int, group, int, id);
-  Array* result = process->object_heap()->allocate_array(7, Smi::zero());
+  Array* result = process->object_heap()->allocate_array(Scheduler::PROCESS_STATS_LENGTH, Smi::zero());
   if (result == null) ALLOCATION_FAILED;
   if (group == -1) group = process->group()->id();
   if (id == -1) id = process->id();
@@ -917,6 +918,27 @@ PRIMITIVE(process_stats) {
   return success ? result : process->program()->null_object();
 }
 
+PRIMITIVE(gc_stats) {
+  int64 stats[Scheduler::GC_STATS_LENGTH];
+  VM::current()->scheduler()->gc_stats(stats);
+  Array* result = process->object_heap()->allocate_array(Scheduler::GC_STATS_LENGTH, Smi::zero());
+  if (result == null) ALLOCATION_FAILED;
+  for (int i = 0; i < Scheduler::GC_STATS_LENGTH; i++) {
+    Object* value = Primitive::integer(stats[i], process);
+    if (Primitive::is_error(value)) return value;
+    result->at_put(i, value);
+  }
+  return result;
+}
+
+PRIMITIVE(set_process_priority) {
+  ARGS(int, id, int, priority);
+  if (priority < 0 || priority > Process::MAX_PRIORITY) OUT_OF_RANGE;
+  if (id == -1) id = process->id();
+  bool success = VM::current()->scheduler()->set_priority(process->group(), id, priority);
+  return BOOL(success);
+}
+
 PRIMITIVE(random) {
   return Smi::from(process->random() & 0xfffffff);
 }
@@ -954,14 +976,14 @@ PRIMITIVE(string_length) {
 
 PRIMITIVE(string_hash_code) {
   ARGS(String, receiver);
-  return Smi::from(receiver->hash_code() >> 2);
+  return Smi::from(receiver->hash_code());
 }
 
 PRIMITIVE(string_slice_hash_code) {
   ARGS(Blob, receiver);
   auto hash = String::compute_hash_code_for(reinterpret_cast<const char*>(receiver.address()),
                                             receiver.length());
-  return Smi::from(hash >> 2);
+  return Smi::from(hash);
 }
 
 PRIMITIVE(hash_simple_json_string) {
@@ -973,7 +995,7 @@ PRIMITIVE(hash_simple_json_string) {
     if (c == '"') {
       auto hash = String::compute_hash_code_for(reinterpret_cast<const char*>(bytes.address() + offset),
                                                 i - offset);
-      return Smi::from(hash >> 2);
+      return Smi::from(hash);
     }
   }
   return Smi::from(-1);
@@ -1052,6 +1074,36 @@ PRIMITIVE(size_of_json_number) {
   return Smi::from(is_float ? -result : result);
 }
 
+// Fails with INVALID_ARGUMENT on anything the native decoder doesn't handle,
+// including syntax errors.  The caller then uses the Toit decoder.
+PRIMITIVE(json_decode) {
+  ARGS(Blob, bytes);
+  JsonDecoder decoder(process, bytes.address(), bytes.length());
+  return decoder.decode();
+}
+
+// Fails with INVALID_ARGUMENT on anything the native encoder doesn't handle.
+// The caller then uses the Toit encoder.
+PRIMITIVE(json_encode) {
+  ARGS(Object, object, bool, as_string);
+  JsonEncoder encoder(process);
+  Object* result = encoder.encode(object);
+  if (result != null) return result;
+  Error* error = null;
+  if (as_string) {
+    result = process->allocate_string(char_cast(encoder.content()), encoder.length(), &error);
+  } else {
+    ByteArray* array = process->allocate_byte_array(encoder.length(), &error);
+    if (array != null) {
+      ByteArray::Bytes bytes(array);
+      memcpy(bytes.address(), encoder.content(), encoder.length());
+    }
+    result = array;
+  }
+  if (result == null) return error;
+  return result;
+}
+
 PRIMITIVE(string_equals) {
   ARGS(Object, receiver, Object, other)
   if (receiver->is_string() && other->is_string()) {
@@ -1457,6 +1509,7 @@ PRIMITIVE(array_replace) {
   memmove(dest->content() + index * WORD_SIZE,
           source->content() + from * WORD_SIZE,
           len * WORD_SIZE);
+  dest->record_write();
   return process->program()->null_object();
 }
 
@@ -1503,13 +1556,15 @@ PRIMITIVE(list_add) {
 
 PRIMITIVE(byte_array_is_raw_bytes) {
   ARGS(ByteArray, byte_array);
-  bool result = (!byte_array->has_external_address()) || byte_array->external_tag() == RawByteTag;
+  bool result = (!byte_array->has_external_address()) ||
+      byte_array->external_tag() == RawByteTag ||
+      byte_array->has_shared_content();
   return BOOL(result);
 }
 
 PRIMITIVE(byte_array_length) {
   ARGS(ByteArray, receiver);
-  if (!receiver->has_external_address() || receiver->external_tag() == RawByteTag || receiver->external_tag() == MappedFileTag) {
+  if (!receiver->has_external_address() || receiver->external_tag() == RawByteTag || receiver->external_tag() == MappedFileTag || receiver->has_shared_content()) {
     return Smi::from(ByteArray::Bytes(receiver).length());
   }
   WRONG_TYPE;
@@ -1517,7 +1572,7 @@ PRIMITIVE(byte_array_length) {
 
 PRIMITIVE(byte_array_at) {
   ARGS(ByteArray, receiver, int, index);
-  if (!receiver->has_external_address() || receiver->external_tag() == RawByteTag || receiver->external_tag() == MappedFileTag) {
+  if (!receiver->has_external_address() || receiver->external_tag() == RawByteTag || receiver->external_tag() == MappedFileTag || receiver->has_shared_content()) {
     ByteArray::Bytes bytes(receiver);
     if (!bytes.is_valid_index(index)) OUT_OF_BOUNDS;
     return Smi::from(bytes.at(index));
@@ -1545,6 +1600,19 @@ PRIMITIVE(byte_array_new) {
   return result;
 }
 
+PRIMITIVE(byte_array_new_shared) {
+  ARGS(Blob, content);
+  AllocationManager allocation(process);
+  uint8* memory = allocation.alloc(SharedBuffer::allocation_size(content.length()));
+  if (memory == null) ALLOCATION_FAILED;
+  SharedBuffer* buffer = SharedBuffer::initialize(memory, content.length());
+  memcpy(buffer->data(), content.address(), content.length());
+  ByteArray* result = process->object_heap()->allocate_shared_byte_array(buffer, true);
+  if (result == null) ALLOCATION_FAILED;
+  allocation.keep_result();
+  return result;
+}
+
 PRIMITIVE(byte_array_new_external) {
   ARGS(int, length);
   if (length < 0) OUT_OF_BOUNDS;
@@ -1701,31 +1769,61 @@ PRIMITIVE(task_transfer) {
   return Smi::from(42);
 }
 
-PRIMITIVE(process_send) {
-  ARGS(int, process_id, int, type, Object, array);
+// Creates a system message with the content of [array].  Shared buffers are
+// passed by reference and external byte arrays are taken over, so only on-heap
+// content needs copying.  Returns null and sets [error] on failure.
+static SystemMessage* create_system_message(Process* process, int type, Object* array, bool* take_external_data, Object** error) {
+  if (array->is_byte_array() && ByteArray::cast(array)->has_shared_content()) {
+    ByteArray::Bytes bytes(ByteArray::cast(array));
+    SharedBuffer* shared = SharedBuffer::from_data(bytes.address());
+    shared->acquire();
+    SystemMessage* message = _new SystemMessage(type, process->group()->id(), process->id(), shared);
+    if (message == null) {
+      shared->release();
+      *error = Primitive::mark_as_error(process->program()->malloc_failed());
+    }
+    *take_external_data = false;
+    return message;
+  }
 
-  bool take_external_data = array->is_byte_array() &&
+  *take_external_data = array->is_byte_array() &&
       ByteArray::cast(array)->has_external_address();
 
   int length;
   uint8* data = null;
-  if (take_external_data) {
+  if (*take_external_data) {
     ByteArray::Bytes bytes(ByteArray::cast(array));
     length = bytes.length();
     data = bytes.address();
   } else {
     const uint8* array_address;
-    if (!array->byte_content(process->program(), &array_address, &length, STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+    if (!array->byte_content(process->program(), &array_address, &length, STRINGS_OR_BYTE_ARRAYS)) {
+      *error = Primitive::mark_as_error(process->program()->wrong_object_type());
+      return null;
+    }
     data = unvoid_cast<uint8_t*>(malloc(length));
-    if (data == null) MALLOC_FAILED;
+    if (data == null) {
+      *error = Primitive::mark_as_error(process->program()->malloc_failed());
+      return null;
+    }
     memcpy(data, array_address, length);
   }
 
   SystemMessage* message = _new SystemMessage(type, process->group()->id(), process->id(), data, length);
   if (message == null) {
-    if (!take_external_data) free(data);
-    MALLOC_FAILED;
+    if (!*take_external_data) free(data);
+    *error = Primitive::mark_as_error(process->program()->malloc_failed());
   }
+  return message;
+}
+
+PRIMITIVE(process_send) {
+  ARGS(int, process_id, int, type, Object, array);
+
+  bool take_external_data;
+  Object* error = null;
+  SystemMessage* message = create_system_message(process, type, array, &take_external_data, &error);
+  if (message == null) return error;
 
   // From here on, the destructor of SystemMessage will free the data.
   scheduler_err_t result = VM::current()->scheduler()->send_message(process_id, message);
@@ -1747,28 +1845,10 @@ PRIMITIVE(process_send) {
 PRIMITIVE(system_send) {
   ARGS(int, type, Object, array);
 
-  bool take_external_data = array->is_byte_array() &&
-      ByteArray::cast(array)->has_external_address();
-
-  int length;
-  uint8* data = null;
-  if (take_external_data) {
-    ByteArray::Bytes bytes(ByteArray::cast(array));
-    length = bytes.length();
-    data = bytes.address();
-  } else {
-    const uint8* array_address;
-    if (!array->byte_content(process->program(), &array_address, &length, STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
-    data = unvoid_cast<uint8_t*>(malloc(length));
-    if (data == null) MALLOC_FAILED;
-    memcpy(data, array_address, length);
-  }
-
-  SystemMessage* message = _new SystemMessage(type, process->group()->id(), process->id(), data, length);
-  if (message == null) {
-    if (!take_external_data) free(data);
-    MALLOC_FAILED;
-  }
+  bool take_external_data;
+  Object* error = null;
+  SystemMessage* message = create_system_message(process, type, array, &take_external_data, &error);
+  if (message == null) return error;
 
   // From here on, the destructor of SystemMessage will free the data.
   scheduler_err_t result = VM::current()->scheduler()->send_system_message(message);
@@ -1805,9 +1885,16 @@ PRIMITIVE(task_receive_message) {
     if (array == null) ALLOCATION_FAILED;
 
     SystemMessage* system = static_cast<SystemMessage*>(message);
-    ByteArray* proxy = process->object_heap()->allocate_proxy(system->length(), system->data(), true);
-    if (proxy == null) ALLOCATION_FAILED;
-    process->register_external_allocation(system->length());
+    ByteArray* proxy;
+    if (system->shared() != null) {
+      // Shared buffers are accounted to the process that created them.
+      proxy = process->object_heap()->allocate_shared_byte_array(system->shared(), false);
+      if (proxy == null) ALLOCATION_FAILED;
+    } else {
+      proxy = process->object_heap()->allocate_proxy(system->length(), system->data(), true);
+      if (proxy == null) ALLOCATION_FAILED;
+      process->register_external_allocation(system->length());
+    }
     system->clear_data();
 
     array->at_put(0, Smi::from(system->type()));
@@ -1964,6 +2051,10 @@ PRIMITIVE(encode_error) {
   return result;
 }
 
+PRIMITIVE(hash_index_shift) {
+  return Smi::from(Interpreter::HASH_INDEX_SHIFT);
+}
+
 PRIMITIVE(rebuild_hash_index) {
   ARGS(Object, o, Object, n);
   // Sometimes the array is too big, and is a large array.  In this case, use
@@ -2071,6 +2162,93 @@ PRIMITIVE(profiler_uninstall) {
 #endif
 }
 
+PRIMITIVE(sampling_profiler_install) {
+  if (process->sampling_profiler() != null) ALREADY_EXISTS;
+  int result = process->install_sampling_profiler();
+  if (result == -1) MALLOC_FAILED;
+  return Smi::from(result);
+}
+
+PRIMITIVE(sampling_profiler_start) {
+  if (process->sampling_profiler() == null) ALREADY_CLOSED;
+  if (process->is_sampling()) return process->program()->false_object();
+  process->set_sampling(true);
+  VM::current()->scheduler()->sampling_started();
+  return process->program()->true_object();
+}
+
+PRIMITIVE(sampling_profiler_stop) {
+  if (process->sampling_profiler() == null) ALREADY_CLOSED;
+  if (!process->is_sampling()) return process->program()->false_object();
+  process->set_sampling(false);
+  return process->program()->true_object();
+}
+
+// Runs [encode] on a program oriented encoder and returns the encoded bytes
+// in a byte array.
+template<typename F>
+static Object* encode_to_byte_array(Process* process, F encode) {
+  int size = 4096;
+  while (true) {
+    MallocedBuffer buffer(size);
+    if (buffer.malloc_failed()) MALLOC_FAILED;
+    ProgramOrientedEncoder encoder(process->program(), &buffer);
+    if (!encode(&encoder)) {
+      // The buffer keeps counting past its end, so we know the exact size
+      // needed for the second attempt.
+      size = buffer.size() + 1;
+      continue;
+    }
+    Error* error = null;
+    ByteArray* result = process->allocate_byte_array(buffer.size(), &error);
+    if (result == null) return error;
+    ByteArray::Bytes bytes(result);
+    memcpy(bytes.address(), buffer.content(), buffer.size());
+    return result;
+  }
+}
+
+PRIMITIVE(sampling_profiler_encode) {
+  ARGS(String, title);
+  SamplingProfiler* profiler = process->sampling_profiler();
+  if (profiler == null) ALREADY_CLOSED;
+  return encode_to_byte_array(process, [&](ProgramOrientedEncoder* encoder) -> bool {
+    return encoder->encode_sampled_profile(profiler, title);
+  });
+}
+
+PRIMITIVE(sampling_profiler_uninstall) {
+  if (process->sampling_profiler() == null) ALREADY_CLOSED;
+  process->uninstall_sampling_profiler();
+  return process->program()->null_object();
+}
+
+PRIMITIVE(allocation_profiler_install) {
+  ARGS(int, interval);
+  if (interval <= 0) INVALID_ARGUMENT;
+  ObjectHeap* heap = process->object_heap();
+  if (heap->allocation_profiler() != null) ALREADY_EXISTS;
+  int result = heap->install_allocation_profiler(interval);
+  if (result == -1) MALLOC_FAILED;
+  return Smi::from(result);
+}
+
+PRIMITIVE(allocation_profiler_encode) {
+  ARGS(String, title);
+  AllocationProfiler* profiler = process->object_heap()->allocation_profiler();
+  if (profiler == null) ALREADY_CLOSED;
+  return encode_to_byte_array(process, [&](ProgramOrientedEncoder* encoder) -> bool {
+    return encoder->encode_allocation_profile(profiler, title);
+  });
+}
+
+PRIMITIVE(allocation_profiler_uninstall) {
+  ObjectHeap* heap = process->object_heap();
+  if (heap->allocation_profiler() == null) ALREADY_CLOSED;
+  heap->uninstall_allocation_profiler();
+  return process->program()->null_object();
+}
+
 PRIMITIVE(set_max_heap_size) {
   ARGS(word, max_bytes);
   process->set_max_heap_size(max_bytes);
@@ -42,6 +42,8 @@ Process::Process(Program* program, ProcessGroup* group, Block* initial_block)
     , _object_heap(program, this, initial_block)
     , _memory_usage(Usage("initial object heap"))
     , _last_bytes_allocated(0)
+    , _incoming(null)
+    , _message_count(0)
     , _random_seeded(false)
     , _random_state0(1)
     , _random_state1(2)
@@ -67,8 +69,11 @@ Process::Process(Program* program, ProcessGroup* group, SnapshotBundle bundle, c
   : Process(program, group, initial_block) {
   _entry = program->entry();
   _args = args;
-  ByteArray* snap = _object_heap.allocate_external_byte_array(bundle.size(), bundle.buffer(), true, false);
-  _object_heap.register_external_allocation(bundle.size());
+  // A mapped bundle is owned by the caller. It is backed by the file, so it
+  // doesn't count against the heap's external memory either.
+  bool dispose = !bundle.is_mapped();
+  ByteArray* snap = _object_heap.allocate_external_byte_array(bundle.size(), bundle.buffer(), dispose, false);
+  if (dispose) _object_heap.register_external_allocation(bundle.size());
 
   // We don't run from snapshot on the device so we can assume that allocation
   // does not fail on a newly created heap.
@@ -103,6 +108,7 @@ Process::~Process() {
     r->tear_down();  // Also removes from linked list.
   }
   OS::close(_current_directory);
+  delete _sampling_profiler;
 
   // Use [has_message] to ensure that system_acks are processed and message
   // budget is returned.
@@ -225,49 +231,63 @@ ByteArray* Process::allocate_byte_array(int length, Error** error, bool force_ex
   return null;
 }
 
-void Process::_append_message(Message* message) {
-  Locker locker(OS::scheduler_mutex());  // Fix this
+bool Process::_append_message(Message* message) {
   if (message->is_object_notify()) {
     ObjectNotifyMessage* obj_notify = static_cast<ObjectNotifyMessage*>(message);
-    if (obj_notify->is_queued()) return;
-    obj_notify->mark_queued();
+    if (!obj_notify->mark_queued()) return false;
+  }
+  _message_count++;
+  Message* head = _incoming;
+  do {
+    message->_next_incoming = head;
+  } while (!_incoming.compare_exchange_weak(head, message));
+  return true;
+}
+
+void Process::_take_incoming_messages() {
+  Message* head = _incoming.exchange(null);
+  if (head == null) return;
+  // The incoming stack has the newest message first.
+  Message* reversed = null;
+  while (head != null) {
+    Message* next = head->_next_incoming;
+    head->_next_incoming = reversed;
+    reversed = head;
+    head = next;
+  }
+  while (reversed != null) {
+    Message* next = reversed->_next_incoming;
+    reversed->_next_incoming = null;
+    _messages.append(reversed);
+    reversed = next;
   }
-  _messages.append(message);
 }
 
 bool Process::has_messages() {
-  Locker locker(OS::scheduler_mutex());  // Fix this
+  if (!_messages.is_empty()) return true;
+  _take_incoming_messages();
   return !_messages.is_empty();
 }
 
 Message* Process::peek_message() {
-  Locker locker(OS::scheduler_mutex());  // Fix this
+  if (_messages.is_empty()) _take_incoming_messages();
   return _messages.first();
 }
 
 void Process::remove_first_message() {
-  Locker locker(OS::scheduler_mutex());  // Fix this
   ASSERT(!_messages.is_empty());
   Message* message = _messages.remove_first();
+  _message_count--;
   if (message->is_object_notify()) {
     if (!static_cast<ObjectNotifyMessage*>(message)->mark_dequeued()) return;
   }
   delete message;
 }
 
-int Process::message_count() {
-  Locker locker(OS::scheduler_mutex());  // Fix this
-  int count = 0;
-  for (MessageFIFO::Iterator it = _messages.begin(); it != _messages.end(); ++it) {
-    count++;
-  }
-  return count;
-}
-
-
 void Process::send_mail(Message* message) {
-  _append_message(message);
-  VM::current()->scheduler()->process_ready(this);
+  if (_append_message(message)) {
+    VM::current()->scheduler()->message_sent(this);
+  }
 }
 
 void Process::_ensure_random_seeded() {
@@ -42,6 +42,12 @@ class Message : public MessageFIFO::Element {
 
   bool is_object_notify() const { return message_type() == MESSAGE_OBJECT_NOTIFY; }
   bool is_system() const { return message_type() == MESSAGE_SYSTEM; }
+
+ private:
+  // Link in the incoming stack of the receiving process.
+  Message* _next_incoming = null;
+
+  friend class Process;
 };
 
 // Process is linked into two different linked lists, so we have to make
@@ -57,6 +63,7 @@ class Process : public ProcessListFromProcessGroup::Element,
     PRINT_STACK_TRACE = 1 << 1,
     PREEMPT           = 1 << 2,
     WATCHDOG          = 1 << 3,
+    PROFILE_SAMPLE    = 1 << 4,
   };
 
   enum State {
@@ -124,11 +131,13 @@ class Process : public ProcessListFromProcessGroup::Element,
   Method entry() { return _entry; }
   char** args() { return _args; }
 
-  // Handling of messages and completions.
+  // Handling of messages and completions.  Messages are received only by
+  // the thread that runs the process, or by the scheduler while the process
+  // is not running.
   bool has_messages();
   Message* peek_message();
   void remove_first_message();
-  int message_count();
+  int message_count() const { return _message_count; }
 
   // Signals that a message is for this process.
   void send_mail(Message* message);
@@ -136,7 +145,7 @@ class Process : public ProcessListFromProcessGroup::Element,
   uint64_t random();
   void random_seed(const uint8_t* buffer, size_t size);
 
-  State state() { return _state; }
+  State state() const { return _state; }
   void set_state(State state) { _state = state; }
 
   void add_resource_group(ResourceGroup* r);
@@ -212,6 +221,33 @@ class Process : public ProcessListFromProcessGroup::Element,
    }
   #endif
 
+  int install_sampling_profiler() {
+    ASSERT(sampling_profiler() == null);
+    SamplingProfiler* profiler = _new SamplingProfiler();
+    if (profiler == null) return -1;
+    int result = profiler->allocated_bytes();
+    if (result == -1) {
+      delete profiler;
+    } else {
+      _sampling_profiler = profiler;
+    }
+    return result;
+  }
+  SamplingProfiler* sampling_profiler() { return _sampling_profiler; }
+  void uninstall_sampling_profiler() {
+    set_sampling(false);
+    SamplingProfiler* p = sampling_profiler();
+    _sampling_profiler = null;
+    delete p;
+  }
+
+  // Tells the scheduler whether to take stack samples on every tick while
+  // this process is running.  Kept separate from the profiler itself so the
+  // scheduler never has to look at a profiler that might be uninstalled
+  // concurrently.
+  bool is_sampling() const { return _is_sampling; }
+  void set_sampling(bool value) { _is_sampling = value; }
+
   void set_last_run(int64 us) {
     _last_run_us = us;
   }
@@ -228,9 +264,46 @@ class Process : public ProcessListFromProcessGroup::Element,
     return _unyielded_for_us + (now - _last_run_us);
   }
 
+  // Time since the process was last scheduled on a thread.
+  int64 current_slice_duration(int64 now) {
+    return now - _last_run_us;
+  }
+
+  // Scheduling support.  Processes with a higher priority get longer time
+  // slices and are charged less virtual runtime for the time they run, so
+  // they are picked sooner from the ready queues.
+  static const int DEFAULT_PRIORITY = 128;
+  static const int MAX_PRIORITY = 255;
+  int priority() { return _priority; }
+  void set_priority(int priority) { _priority = priority; }
+
+  int64 vruntime() { return _vruntime_us; }
+  void set_vruntime(int64 us) { _vruntime_us = us; }
+  void account_run(int64 us) {
+    _vruntime_us += us * DEFAULT_PRIORITY / (_priority == 0 ? 1 : _priority);
+  }
+
+  int64 ready_since() { return _ready_since_us; }
+  void set_ready_since(int64 us) { _ready_since_us = us; }
+
+  // Histogram of the time from being scheduled to running, with buckets for
+  // below 1 ms, 10 ms, 100 ms, 1 s, and the rest.
+  static const int LATENCY_BUCKETS = 5;
+  void record_scheduling_latency(int64 us) {
+    int bucket = 0;
+    for (int64 limit = 1000; bucket < LATENCY_BUCKETS - 1 && us >= limit; limit *= 10) bucket++;
+    _scheduling_latency[bucket]++;
+  }
+  int scheduling_latency_count(int bucket) { return _scheduling_latency[bucket]; }
+
  private:
   Process(Program* program, ProcessGroup* group, Block* initial_block);
-  void _append_message(Message* message);
+  // Adds a message to the mailbox without taking any locks.  Can be called
+  // from any thread.  Returns false if the message was an object notification
+  // that was already queued.
+  bool _append_message(Message* message);
+  // Moves the incoming messages to the end of _messages.
+  void _take_incoming_messages();
   void _ensure_random_seeded();
 
   int const _id;
@@ -245,7 +318,11 @@ class Process : public ProcessListFromProcessGroup::Element,
   Usage _memory_usage;
   int64 _last_bytes_allocated;
 
+  // The mailbox.  Senders push messages onto the lock-free _incoming stack,
+  // and the receiver moves them to _messages in the order they were sent.
+  std::atomic<Message*> _incoming;
   MessageFIFO _messages;
+  std::atomic<int> _message_count;
 
   bool _random_seeded;
   uint64_t _random_state0;
@@ -254,7 +331,8 @@ class Process : public ProcessListFromProcessGroup::Element,
   int _current_directory;
 
   uint32_t _signals;
-  State _state;
+  // Written with the scheduler lock held, but read by senders without it.
+  std::atomic<State> _state;
   SchedulerThread* _scheduler_thread;
 
   bool _construction_failed = false;
@@ -262,10 +340,16 @@ class Process : public ProcessListFromProcessGroup::Element,
 
   int64 _last_run_us = 0;
   int64 _unyielded_for_us = 0;
+  int _priority = DEFAULT_PRIORITY;
+  int64 _vruntime_us = 0;
+  int64 _ready_since_us = 0;
+  int _scheduling_latency[LATENCY_BUCKETS] = { 0 };
 
 #ifdef PROFILER
   Profiler* _profiler = null;
 #endif
+  SamplingProfiler* _sampling_profiler = null;
+  std::atomic<bool> _is_sampling { false };
 
   ResourceGroupListFromProcess _resource_groups;
   friend class Scheduler;
@@ -338,6 +422,44 @@ class AllocationManager {
   bool _hit_limit;
 };
 
+// An immutable, reference counted buffer in malloced memory.  It can be sent
+// to any number of processes without copying; every holder sees it as a
+// read-only byte array.  The memory is accounted to the process that created
+// the buffer only, so it isn't charged again for every receiver.
+class SharedBuffer {
+ public:
+  // Constructs a buffer with a single reference in [memory], which must be
+  // at least allocation_size(length) bytes.
+  static SharedBuffer* initialize(void* memory, int length) {
+    return new (memory) SharedBuffer(length);
+  }
+
+  static word allocation_size(int length) { return sizeof(SharedBuffer) + length; }
+
+  static SharedBuffer* from_data(uint8* data) {
+    return reinterpret_cast<SharedBuffer*>(data) - 1;
+  }
+
+  uint8* data() { return reinterpret_cast<uint8*>(this + 1); }
+  int length() const { return _length; }
+
+  void acquire() { _references++; }
+
+  // Frees the buffer when the last reference is released.
+  void release() {
+    if (--_references == 0) {
+      this->~SharedBuffer();
+      free(this);
+    }
+  }
+
+ private:
+  explicit SharedBuffer(int length) : _references(1), _length(length) {}
+
+  std::atomic<int> _references;
+  int const _length;
+};
+
 class SystemMessage : public Message {
  public:
   // Some system messages that are created from within the VM.
@@ -349,8 +471,15 @@ class SystemMessage : public Message {
 
   SystemMessage(int type, int gid, int pid, uint8_t* data, int length) : _type(type), _gid(gid), _pid(pid), _data(data), _length(length) { }
   SystemMessage(int type, int gid, int pid) : _type(type), _gid(gid), _pid(pid), _data(null), _length(0) { }
+  // Takes over one reference to the [shared] buffer.
+  SystemMessage(int type, int gid, int pid, SharedBuffer* shared)
+      : _type(type), _gid(gid), _pid(pid), _data(shared->data()), _length(shared->length()), _shared(shared) { }
   ~SystemMessage() {
-    free(_data);
+    if (_shared != null) {
+      _shared->release();
+    } else {
+      free(_data);
+    }
   }
 
   MessageType message_type() const { return MESSAGE_SYSTEM; }
@@ -361,12 +490,14 @@ class SystemMessage : public Message {
 
   uint8_t* data() const { return _data; }
   int length() const { return _length; }
+  SharedBuffer* shared() const { return _shared; }
 
   void set_pid(int pid) { _pid = pid; }
 
   void clear_data() {
     _data = null;
     _length = 0;
+    _shared = null;
   }
 
  private:
@@ -376,6 +507,7 @@ class SystemMessage : public Message {
 
   uint8_t* _data;
   int _length;
+  SharedBuffer* _shared = null;
 };
 
 class ObjectNotifyMessage : public Message {
@@ -386,7 +518,8 @@ class ObjectNotifyMessage : public Message {
   ~ObjectNotifyMessage() {}
 
   bool is_queued() { return _queued; }
-  void mark_queued() { _queued = true; }
+  // Returns false if the message was already queued.
+  bool mark_queued() { return !_queued.exchange(true); }
   bool mark_dequeued() {
     _queued = false;
     return _notifier == null;
@@ -405,7 +538,7 @@ class ObjectNotifyMessage : public Message {
 
  private:
   ObjectNotifier* _notifier;
-  bool _queued;
+  std::atomic<bool> _queued;
 };
 
 } // namespace toit
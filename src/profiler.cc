@@ -174,3 +174,211 @@ int Profiler::compute_index_for_absolute_bci(int absolute_bci) {
 } // namespace toit
 
 #endif
+
+namespace toit {
+
+SamplingProfiler::SamplingProfiler() {
+  _entries = unvoid_cast<Entry*>(calloc(MAX_STACKS, sizeof(Entry)));
+  _frames = unvoid_cast<int32*>(malloc(FRAME_POOL_SIZE * sizeof(int32)));
+  if (_entries == null || _frames == null) {
+    free(_entries);
+    free(_frames);
+    _entries = null;
+    _frames = null;
+  } else {
+    _allocated_bytes = MAX_STACKS * sizeof(Entry) + FRAME_POOL_SIZE * sizeof(int32);
+  }
+}
+
+SamplingProfiler::~SamplingProfiler() {
+  free(_entries);
+  free(_frames);
+}
+
+void SamplingProfiler::sample(Stack* stack, Program* program) {
+  if (_entries == null) return;
+  _sample_count++;
+  int32 frames[MAX_FRAMES];
+  int depth = stack->active_bcis(program, frames, MAX_FRAMES);
+  if (depth == 0) {
+    _dropped_count++;
+    return;
+  }
+  // FNV-1a hash of the bcis.
+  uint32 hash = 2166136261u;
+  for (int i = 0; i < depth; i++) {
+    hash = (hash ^ static_cast<uint32>(frames[i])) * 16777619u;
+  }
+  // Open addressing with linear probing.  The table is never filled more
+  // than 3/4, so the probing always terminates.
+  int mask = MAX_STACKS - 1;
+  for (int index = hash & mask; true; index = (index + 1) & mask) {
+    Entry* entry = &_entries[index];
+    if (entry->depth == 0) {
+      if (_used_entries >= MAX_STACKS / 4 * 3 || _used_frames + depth > FRAME_POOL_SIZE) {
+        _dropped_count++;
+        return;
+      }
+      memcpy(&_frames[_used_frames], frames, depth * sizeof(int32));
+      entry->hash = hash;
+      entry->depth = depth;
+      entry->offset = _used_frames;
+      entry->count = 1;
+      _used_frames += depth;
+      _used_entries++;
+      return;
+    }
+    if (entry->hash == hash &&
+        entry->depth == depth &&
+        memcmp(&_frames[entry->offset], frames, depth * sizeof(int32)) == 0) {
+      entry->count++;
+      return;
+    }
+  }
+}
+
+void SamplingProfiler::encode_on(ProgramOrientedEncoder* encoder, String* title) {
+  encoder->write_header(3 + 2 * _used_entries + _used_frames, 'C');
+  encoder->encode(title);
+  encoder->write_int(_sample_count);
+  encoder->write_int(_dropped_count);
+  if (_entries == null) return;
+  for (int index = 0; index < MAX_STACKS; index++) {
+    Entry* entry = &_entries[index];
+    if (entry->depth == 0) continue;
+    encoder->write_int(entry->count);
+    encoder->write_int(entry->depth);
+    for (int i = 0; i < entry->depth; i++) {
+      encoder->write_int(_frames[entry->offset + i]);
+    }
+  }
+}
+
+} // namespace toit
+
+namespace toit {
+
+AllocationProfiler::AllocationProfiler(int interval)
+    : _interval(interval)
+    , _countdown(interval)
+    , _start_time(OS::get_monotonic_time()) {
+  ASSERT(interval > 0);
+  _samples = unvoid_cast<Sample*>(malloc(MAX_SAMPLES * sizeof(Sample)));
+  _sites = unvoid_cast<Site*>(calloc(MAX_SITES, sizeof(Site)));
+  if (_samples == null || _sites == null) {
+    free(_samples);
+    free(_sites);
+    _samples = null;
+    _sites = null;
+  } else {
+    _allocated_bytes = MAX_SAMPLES * sizeof(Sample) + MAX_SITES * sizeof(Site);
+  }
+}
+
+AllocationProfiler::~AllocationProfiler() {
+  free(_samples);
+  free(_sites);
+}
+
+void AllocationProfiler::_sample(HeapObject* object, int byte_size) {
+  // The sample stands for all the bytes allocated since the previous one.
+  int weight = _interval - _countdown;
+  _countdown = _interval;
+  _sample_count++;
+  if (_used_samples == MAX_SAMPLES) {
+    if (_first_unresolved == 0) {
+      _dropped_count++;
+      return;
+    }
+    _evict_sample();
+  }
+  Sample* sample = &_samples[_used_samples++];
+  sample->object = object;
+  sample->site = -1;
+  sample->weight = weight;
+}
+
+void AllocationProfiler::_evict_sample() {
+  // Make room by no longer following one of the resolved samples.  They are
+  // taken in turn, so long-lived allocations keep a share of the table while
+  // new sites are still sampled.  The evicted sample's bytes stay counted as
+  // live, since we can't tell when the object dies.
+  int last_resolved = _first_unresolved - 1;
+  int index = _next_eviction++ % _first_unresolved;
+  _evicted_count++;
+  // Keep the resolved samples before the unresolved ones.
+  _samples[index] = _samples[last_resolved];
+  _samples[last_resolved] = _samples[_used_samples - 1];
+  _first_unresolved--;
+  _used_samples--;
+}
+
+void AllocationProfiler::resolve_samples(int absolute_bci) {
+  for (int i = _first_unresolved; i < _used_samples; i++) {
+    _resolve(&_samples[i], absolute_bci);
+  }
+  _first_unresolved = _used_samples;
+}
+
+bool AllocationProfiler::_resolve(Sample* sample, int absolute_bci) {
+  int index = _site_index(absolute_bci, sample->object->class_id()->value());
+  if (index == -1) {
+    _dropped_count++;
+    sample->object = null;
+    return false;
+  }
+  Site* site = &_sites[index];
+  site->samples++;
+  site->allocated_bytes += sample->weight;
+  site->live_bytes += sample->weight;
+  sample->site = index;
+  return true;
+}
+
+void AllocationProfiler::_sample_died(Sample* sample, bool unresolved) {
+  if (sample->object == null) return;  // Already dropped.
+  // Samples that die before reaching a resolution point are attributed
+  // to an unknown site.
+  if (unresolved && !_resolve(sample, -1)) return;
+  _sites[sample->site].live_bytes -= sample->weight;
+}
+
+int AllocationProfiler::_site_index(int absolute_bci, int class_id) {
+  uint32 hash = (static_cast<uint32>(absolute_bci) * 31) ^ static_cast<uint32>(class_id);
+  // Open addressing with linear probing.  The table is never filled more
+  // than 3/4, so the probing always terminates.
+  int mask = MAX_SITES - 1;
+  for (int index = hash & mask; true; index = (index + 1) & mask) {
+    Site* site = &_sites[index];
+    if (site->samples == 0) {
+      if (_used_sites >= MAX_SITES / 4 * 3) return -1;
+      site->absolute_bci = absolute_bci;
+      site->class_id = class_id;
+      _used_sites++;
+      return index;
+    }
+    if (site->absolute_bci == absolute_bci && site->class_id == class_id) return index;
+  }
+}
+
+void AllocationProfiler::encode_on(ProgramOrientedEncoder* encoder, String* title) {
+  encoder->write_header(6 + 5 * _used_sites, 'a');
+  encoder->encode(title);
+  encoder->write_int(_interval);
+  encoder->write_int(OS::get_monotonic_time() - _start_time);
+  encoder->write_int(_sample_count);
+  encoder->write_int(_dropped_count);
+  encoder->write_int(_evicted_count);
+  if (_sites == null) return;
+  for (int index = 0; index < MAX_SITES; index++) {
+    Site* site = &_sites[index];
+    if (site->samples == 0) continue;
+    encoder->write_int(site->absolute_bci);
+    encoder->write_int(site->class_id);
+    encoder->write_int(site->samples);
+    encoder->write_int(site->allocated_bytes);
+    encoder->write_int(site->live_bytes);
+  }
+}
+
+} // namespace toit
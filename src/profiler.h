@@ -67,4 +67,157 @@ class Profiler {
 
 } // namespace toit
 
+#endif  // PROFILER
+
+namespace toit {
+
+// A statistical profiler that records the call stack of a process whenever
+// the scheduler asks for a sample.  Identical stacks are folded into one
+// entry with a count, so the memory used is bounded by the number of
+// distinct stacks rather than the number of samples.  Unlike [Profiler] it
+// needs no support from the interpreter and is always available.
+class SamplingProfiler {
+ public:
+  SamplingProfiler();
+  ~SamplingProfiler();
+
+  // Returns the number of bytes used for the tables, or -1 if they
+  // couldn't be allocated.
+  int allocated_bytes() const { return _allocated_bytes; }
+
+  int64 sample_count() const { return _sample_count; }
+  int64 dropped_count() const { return _dropped_count; }
+
+  // Records the call stack of a stack that is not currently being run by
+  // an interpreter.
+  void sample(Stack* stack, Program* program);
+
+  void encode_on(ProgramOrientedEncoder* encoder, String* title);
+
+ private:
+  // Deeper stacks are truncated, keeping the innermost frames.
+  static const int MAX_FRAMES = 64;
+#ifdef TOIT_FREERTOS
+  static const int MAX_STACKS = 128;
+  static const int FRAME_POOL_SIZE = 2 * KB;
+#else
+  static const int MAX_STACKS = 2 * KB;
+  static const int FRAME_POOL_SIZE = 32 * KB;
 #endif
+
+  struct Entry {
+    uint32 hash;
+    int depth;   // Zero for unused entries.
+    int offset;  // Index of the innermost frame in the frame pool.
+    int64 count;
+  };
+
+  Entry* _entries = null;
+  int32* _frames = null;
+  int _used_entries = 0;
+  int _used_frames = 0;
+  int64 _sample_count = 0;
+  int64 _dropped_count = 0;
+  int _allocated_bytes = -1;
+};
+
+// Samples the allocations in an object heap, roughly one for every
+// [interval] bytes allocated, and attributes each sample to the bytecode that
+// caused it and the class of the allocated object.  The sampled objects are
+// held weakly and updated on every scavenge, so the report can tell how much
+// of what each site allocated is still alive.
+class AllocationProfiler {
+ public:
+  explicit AllocationProfiler(int interval);
+  ~AllocationProfiler();
+
+  // Returns the number of bytes used for the tables, or -1 if they
+  // couldn't be allocated.
+  int allocated_bytes() const { return _allocated_bytes; }
+
+  // Called by the heap for every allocation.
+  void allocated(HeapObject* object, int byte_size) {
+    _countdown -= byte_size;
+    if (_countdown <= 0) _sample(object, byte_size);
+  }
+
+  // Whether there are samples that have not yet been attributed to a site.
+  bool has_unresolved_samples() const { return _first_unresolved < _used_samples; }
+
+  // Attributes the samples taken since the last call to the bytecode at
+  // [absolute_bci].
+  void resolve_samples(int absolute_bci);
+
+  // Updates the sampled objects during a scavenge, once all live objects
+  // have been copied.  [forward] returns the new address of a sampled object,
+  // or null if it didn't survive.
+  template<typename F> void scavenge_samples(F forward) {
+    int used = 0;
+    int first_unresolved = -1;
+    for (int i = 0; i < _used_samples; i++) {
+      Sample sample = _samples[i];
+      HeapObject* moved = sample.object == null ? null : forward(sample.object);
+      if (moved == null) {
+        _sample_died(&sample, i >= _first_unresolved);
+        continue;
+      }
+      if (i >= _first_unresolved && first_unresolved == -1) first_unresolved = used;
+      sample.object = moved;
+      _samples[used++] = sample;
+    }
+    _used_samples = used;
+    _first_unresolved = first_unresolved == -1 ? used : first_unresolved;
+  }
+
+  void encode_on(ProgramOrientedEncoder* encoder, String* title);
+
+ private:
+#ifdef TOIT_FREERTOS
+  static const int MAX_SAMPLES = 256;
+  static const int MAX_SITES = 64;
+#else
+  static const int MAX_SAMPLES = 4 * KB;
+  static const int MAX_SITES = 1 * KB;
+#endif
+
+  struct Sample {
+    HeapObject* object;  // Null if the sample has been dropped.
+    int site;            // Index in the site table, once resolved.
+    int weight;          // Number of allocated bytes this sample stands for.
+  };
+
+  struct Site {
+    int absolute_bci;  // -1 if the allocation site is unknown.
+    int class_id;
+    int64 samples;
+    int64 allocated_bytes;
+    int64 live_bytes;
+  };
+
+  int const _interval;
+  int _countdown;
+  int64 _start_time;
+
+  Sample* _samples = null;
+  int _used_samples = 0;
+  // Samples at and after this index haven't been attributed to a site yet.
+  int _first_unresolved = 0;
+
+  Site* _sites = null;
+  int _used_sites = 0;
+
+  int64 _sample_count = 0;
+  int64 _dropped_count = 0;
+  // Live samples that were no longer followed to make room for new ones.
+  int64 _evicted_count = 0;
+  uint32 _next_eviction = 0;
+  int _allocated_bytes = -1;
+
+  void _sample(HeapObject* object, int byte_size);
+  void _evict_sample();
+  int _site_index(int absolute_bci, int class_id);
+  bool _resolve(Sample* sample, int absolute_bci);
+  void _sample_died(Sample* sample, bool unresolved);
+};
+
+} // namespace toit
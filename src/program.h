@@ -78,6 +78,7 @@ namespace toit {
   ID(task_class_id)              \
   ID(large_array_class_id)       \
   ID(lazy_initializer_class_id)  \
+  ID(map_class_id)               \
 
 // The reflective structure of a program.
 class Program : public FlashAllocation {
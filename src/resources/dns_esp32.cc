@@ -194,6 +194,31 @@ PRIMITIVE(lookup_result) {
   return result;
 }
 
+// LwIP only gives us a single address, so the list has at most one entry.
+PRIMITIVE(lookup_all_result) {
+  ARGS(DNSResourceGroup, resource_group, LookupResult, lookup);
+
+  Object* result = null;
+  if (lookup->err() != ERR_OK) {
+    result = lwip_error(process, lookup->err());
+  } else {
+    Array* array = process->object_heap()->allocate_array(1, process->program()->null_object());
+    if (array == null) ALLOCATION_FAILED;
+    Error* error = null;
+    ByteArray* address = process->allocate_byte_array(lookup->length(), &error);
+    if (address == null) return error;
+
+    memcpy(ByteArray::Bytes(address).address(), lookup->address(), lookup->length());
+    array->at_put(0, address);
+    result = array;
+  }
+
+  resource_group->unregister_resource(lookup);  // Also deletes lookup.
+  lookup_proxy->clear_external_address();
+
+  return result;
+}
+
 } // namespace toit
 
 #endif // defined(TOIT_FREERTOS) || defined(TOIT_USE_LWIP)
@@ -39,8 +39,9 @@ class DNSResourceGroup : public ResourceGroup {
   DNSResourceGroup(Process* process, EventSource* event_source)
       : ResourceGroup(process, event_source) {}
 
-  DNSLookupRequest* lookup(char* address) {
-    DNSLookupRequest* request = _new DNSLookupRequest(this, unsigned_cast(address));
+  DNSLookupRequest* lookup(char* hostname) {
+    DNSLookupRequest* request = _new DNSLookupRequest(this, hostname);
+    if (request == null) return null;
     register_resource(request);
     return request;
   }
@@ -69,22 +70,93 @@ PRIMITIVE(lookup) {
   if (proxy == null) ALLOCATION_FAILED;
   // NOTE: The contract is lookup will deal with freeing.
   char* name = hostname->cstr_dup();
-  proxy->set_external_address(resource_group->lookup(name));
+  if (name == null) MALLOC_FAILED;
+  DNSLookupRequest* request = resource_group->lookup(name);
+  if (request == null) {
+    free(name);
+    MALLOC_FAILED;
+  }
+  proxy->set_external_address(request);
   return proxy;
 }
 
+// EAI_MEMORY is reported with its message rather than as MALLOC_FAILED: the
+// lookup is over, so retrying the primitive after a GC would not help.
+static Object* lookup_error(DNSLookupRequest* lookup, Process* process) {
+  if (lookup->system_error() != 0) return Primitive::os_error(lookup->system_error(), process);
+  Error* error = null;
+  String* message = process->allocate_string(gai_strerror(lookup->error()), &error);
+  if (message == null) return error;
+  return Error::from(message);
+}
+
+// The interpreter retries the primitive after a GC when it fails with one of
+// these, so the lookup must not be unregistered yet.
+static bool is_retried_error(Object* result, Process* process) {
+  if (!Primitive::is_error(result)) return false;
+  Object* error = Primitive::unmark_from_error(result);
+  return error == process->program()->malloc_failed() ||
+         error == process->program()->allocation_failed();
+}
+
+static ByteArray* allocate_address(const uint8* address, Process* process, Error** error) {
+  int length = address[0];
+  ByteArray* array = process->allocate_byte_array(length, error);
+  if (array == null) return null;
+  memcpy(ByteArray::Bytes(array).address(), address + 1, length);
+  return array;
+}
+
 PRIMITIVE(lookup_result) {
   ARGS(DNSResourceGroup, resource_group, DNSLookupRequest, lookup);
 
   Object* result = null;
 
   if (lookup->error() != 0) {
-    result = Primitive::os_error(lookup->error(), process);
+    result = lookup_error(lookup, process);
+    if (is_retried_error(result, process)) return result;
   } else {
+    // Prefer the first IPv4 address, as not all callers handle IPv6.
+    const uint8* address = lookup->addresses();
+    for (int offset = 0; offset < lookup->length(); offset += 1 + lookup->addresses()[offset]) {
+      if (lookup->addresses()[offset] == 4) {
+        address = lookup->addresses() + offset;
+        break;
+      }
+    }
     Error* error = null;
-    ByteArray* array = process->allocate_byte_array(lookup->length(), &error);
+    ByteArray* array = allocate_address(address, process, &error);
     if (array == null) return error;
-    memcpy(ByteArray::Bytes(array).address(), lookup->address(), lookup->length());
+    result = array;
+  }
+
+  resource_group->unregister_resource(lookup);
+
+  return result;
+}
+
+PRIMITIVE(lookup_all_result) {
+  ARGS(DNSResourceGroup, resource_group, DNSLookupRequest, lookup);
+
+  Object* result = null;
+
+  if (lookup->error() != 0) {
+    result = lookup_error(lookup, process);
+    if (is_retried_error(result, process)) return result;
+  } else {
+    int count = 0;
+    for (int offset = 0; offset < lookup->length(); offset += 1 + lookup->addresses()[offset]) {
+      count++;
+    }
+    Array* array = process->object_heap()->allocate_array(count, process->program()->null_object());
+    if (array == null) ALLOCATION_FAILED;
+    int index = 0;
+    for (int offset = 0; offset < lookup->length(); offset += 1 + lookup->addresses()[offset]) {
+      Error* error = null;
+      ByteArray* address = allocate_address(lookup->addresses() + offset, process, &error);
+      if (address == null) return error;
+      array->at_put(index++, address);
+    }
     result = array;
   }
 
@@ -35,4 +35,7 @@ enum TCPOption {
   TCP_SEND_BUFFER  = 8,
 };
 
+// Maximum number of chunks written by a single write_vector call.
+static const int TCP_MAX_WRITE_VECTOR = 64;
+
 } // namespace toit
@@ -406,6 +406,31 @@ PRIMITIVE(read)  {
   });
 }
 
+PRIMITIVE(read_into)  {
+  ARGS(SocketResourceGroup, resource_group, LwIPSocket, socket, MutableBlob, buffer, int, from, int, to);
+
+  if (from < 0 || from > to || to > buffer.length()) OUT_OF_BOUNDS;
+
+  return resource_group->event_source()->call_on_thread([&]() -> Object* {
+    if (socket->error() != ERR_OK) return lwip_error(process, socket->error());
+
+    pbuf* p = socket->read_buffer();
+    if (p == null) {
+      if (socket->read_closed()) return process->program()->null_object();
+      return Smi::from(-1);
+    }
+
+    int size = Utils::min(to - from, static_cast<int>(p->tot_len));
+    pbuf_copy_partial(p, buffer.address() + from, size, 0);
+    // Drop the consumed bytes, freeing the pbufs that are fully read.
+    socket->set_read_buffer(pbuf_free_header(p, size));
+
+    if (socket->tpcb() != null) tcp_recved(socket->tpcb(), size);
+
+    return Smi::from(size);
+  });
+}
+
 PRIMITIVE(write) {
   ARGS(SocketResourceGroup, resource_group, LwIPSocket, socket, Blob, data, int, from, int, to);
 
@@ -455,6 +480,58 @@ PRIMITIVE(write) {
   return result;
 }
 
+PRIMITIVE(write_vector) {
+  ARGS(SocketResourceGroup, resource_group, LwIPSocket, socket, Array, chunks);
+
+  int count = Utils::min(chunks->length(), TCP_MAX_WRITE_VECTOR);
+  Blob blobs[TCP_MAX_WRITE_VECTOR];
+  for (int i = 0; i < count; i++) {
+    if (!chunks->at(i)->byte_content(process->program(), &blobs[i], STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+  }
+
+  return resource_group->event_source()->call_on_thread([&]() -> Object* {
+    if (socket->error() != ERR_OK) return lwip_error(process, socket->error());
+
+    int available = tcp_sndbuf(socket->tpcb());
+    if (available == 0) return Smi::from(-1);
+
+    int wrote = 0;
+    err_t err = ERR_OK;
+    for (int i = 0; i < count && available > 0; i++) {
+      int size = Utils::min(available, blobs[i].length());
+      if (size == 0) continue;
+      // Tell LwIP more data follows, so the chunks can share segments.
+      bool more = i + 1 < count && size == blobs[i].length();
+      u8_t flags = TCP_WRITE_FLAG_COPY | (more ? TCP_WRITE_FLAG_MORE : 0);
+      err = tcp_write(socket->tpcb(), blobs[i].address(), size, flags);
+      if (err != ERR_OK) break;
+      wrote += size;
+      available -= size;
+    }
+
+    if (wrote == 0) {
+      if (err == ERR_MEM) {
+        // If send queue is empty, we know the internal allocation failed. Be sure to
+        // trigger GC and retry, as there will be no tcp_sent event.
+        if (tcp_sndqueuelen(socket->tpcb()) == 0) MALLOC_FAILED;
+        // Wait for data being processed.
+        return Smi::from(-1);
+      } else if (err != ERR_OK) {
+        return lwip_error(process, err);
+      }
+      return Smi::from(0);
+    }
+
+    if (tcp_nagle_disabled(socket->tpcb())) {
+      tcp_output(socket->tpcb());
+    }
+    socket->set_send_pending(socket->send_pending() + wrote);
+    tcp_sent(socket->tpcb(), LwIPSocket::on_wrote);
+
+    return Smi::from(wrote);
+  });
+}
+
 PRIMITIVE(close_write) {
   ARGS(SocketResourceGroup, resource_group, LwIPSocket, socket);
 
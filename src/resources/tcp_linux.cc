@@ -26,6 +26,7 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "../objects.h"
@@ -274,6 +275,34 @@ PRIMITIVE(write) {
   return Smi::from(wrote);
 }
 
+PRIMITIVE(write_vector) {
+  ARGS(ByteArray, proxy, IntResource, fd_resource, Array, chunks);
+  USE(proxy);
+  int fd = fd_resource->id();
+
+  int count = Utils::min(chunks->length(), TCP_MAX_WRITE_VECTOR);
+  struct iovec iov[TCP_MAX_WRITE_VECTOR];
+  for (int i = 0; i < count; i++) {
+    Blob chunk;
+    if (!chunks->at(i)->byte_content(process->program(), &chunk, STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+    iov[i].iov_base = const_cast<uint8*>(chunk.address());
+    iov[i].iov_len = chunk.length();
+  }
+
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = iov;
+  message.msg_iovlen = count;
+
+  ssize_t wrote = sendmsg(fd, &message, MSG_NOSIGNAL);
+  if (wrote == -1) {
+    if (errno == EWOULDBLOCK) return Smi::from(-1);
+    return Primitive::os_error(errno, process);
+  }
+
+  return Smi::from(wrote);
+}
+
 PRIMITIVE(read)  {
   ARGS(ByteArray, proxy, IntResource, fd_resource);
   USE(proxy);
@@ -303,6 +332,25 @@ PRIMITIVE(read)  {
   return array;
 }
 
+PRIMITIVE(read_into)  {
+  ARGS(ByteArray, proxy, IntResource, fd_resource, MutableBlob, buffer, int, from, int, to);
+  USE(proxy);
+  int fd = fd_resource->id();
+
+  if (from < 0 || from > to || to > buffer.length()) OUT_OF_BOUNDS;
+  // A zero-length recv would be indistinguishable from end of stream.
+  if (from == to) return Smi::from(0);
+
+  int read = recv(fd, buffer.address() + from, to - from, 0);
+  if (read == -1) {
+    if (errno == EWOULDBLOCK) return Smi::from(-1);
+    return Primitive::os_error(errno, process);
+  }
+  if (read == 0) return process->program()->null_object();
+
+  return Smi::from(read);
+}
+
 PRIMITIVE(error) {
   ARGS(IntResource, fd_resource);
   int fd = fd_resource->id();
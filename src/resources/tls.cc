@@ -17,6 +17,14 @@
 #include <mbedtls/pem.h>
 #include <mbedtls/platform.h>
 
+#include "../top.h"
+
+#if defined(TOIT_LINUX) && !defined(TOIT_USE_LWIP)
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#endif
+
 #include "../heap_report.h"
 #include "../primitive.h"
 #include "../process.h"
@@ -152,7 +160,10 @@ void MbedTLSResourceGroup::init_conf(mbedtls_ssl_config* conf) {
   mbedtls_debug_set_threshold(2);
 #endif
 
+#if MBEDTLS_SSL_IN_CONTENT_LEN < 16384
+  // Ask the peer for records that fit in our reduced input buffer.
   mbedtls_ssl_conf_max_frag_len(conf, MBEDTLS_SSL_MAX_FRAG_LEN_4096);
+#endif
   mbedtls_ssl_conf_verify(conf, toit_tls_verify, this);
 }
 
@@ -200,7 +211,8 @@ MbedTLSSocket::MbedTLSSocket(MbedTLSResourceGroup* group)
   , _outgoing_packet(group->process()->program()->null_object())
   , _outgoing_fullness(0)
   , _incoming_packet(group->process()->program()->null_object())
-  , _incoming_from(0) {
+  , _incoming_from(0)
+  , _direct_fd(-1) {
   ObjectHeap* heap = group->process()->object_heap();
   heap->add_external_root(&_outgoing_packet);
   heap->add_external_root(&_incoming_packet);
@@ -531,6 +543,43 @@ static int toit_tls_recv(void* ctx, unsigned char * buf, size_t len) {
   return result;
 }
 
+#if defined(TOIT_LINUX) && !defined(TOIT_USE_LWIP)
+
+static int toit_tls_send_fd(void* ctx, const unsigned char* buf, size_t len) {
+  auto socket = unvoid_cast<MbedTLSSocket*>(ctx);
+  ssize_t sent = send(socket->direct_fd(), buf, len, MSG_NOSIGNAL);
+  if (sent >= 0) return sent;
+  if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) return MBEDTLS_ERR_SSL_WANT_WRITE;
+  if (errno == EPIPE || errno == ECONNRESET) return MBEDTLS_ERR_NET_CONN_RESET;
+  return MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+static int toit_tls_recv_fd(void* ctx, unsigned char* buf, size_t len) {
+  auto socket = unvoid_cast<MbedTLSSocket*>(ctx);
+  ssize_t received = recv(socket->direct_fd(), buf, len, 0);
+  if (received >= 0) return received;  // Zero is end of file.
+  if (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) return MBEDTLS_ERR_SSL_WANT_READ;
+  if (errno == ECONNRESET) return MBEDTLS_ERR_NET_CONN_RESET;
+  return MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+void MbedTLSSocket::set_direct_fd(int fd) {
+  _direct_fd = fd;
+  mbedtls_ssl_set_bio(&ssl, this, toit_tls_send_fd, toit_tls_recv_fd, null);
+}
+
+#endif
+
+PRIMITIVE(set_direct_fd) {
+#if defined(TOIT_LINUX) && !defined(TOIT_USE_LWIP)
+  ARGS(MbedTLSSocket, socket, IntResource, fd_resource);
+  socket->set_direct_fd(fd_resource->id());
+  return process->program()->true_object();
+#else
+  UNIMPLEMENTED_PRIMITIVE;
+#endif
+}
+
 PRIMITIVE(init_socket) {
   ARGS(BaseMbedTLSSocket, socket, cstring, transport_id);
   socket->apply_certs();
@@ -697,4 +746,17 @@ PRIMITIVE(set_session) {
   return process->program()->null_object();
 }
 
+PRIMITIVE(handshake_stats) {
+  int64 values[TLSEventSource::HANDSHAKE_STATS_LENGTH];
+  TLSEventSource::handshake_stats(values);
+  Array* result = process->object_heap()->allocate_array(TLSEventSource::HANDSHAKE_STATS_LENGTH, Smi::zero());
+  if (result == null) ALLOCATION_FAILED;
+  for (int i = 0; i < TLSEventSource::HANDSHAKE_STATS_LENGTH; i++) {
+    Object* value = Primitive::integer(values[i], process);
+    if (Primitive::is_error(value)) return value;
+    result->at_put(i, value);
+  }
+  return result;
+}
+
 } // namespace toit
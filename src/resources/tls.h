@@ -93,6 +93,13 @@ class MbedTLSSocket : public BaseMbedTLSSocket {
     _outgoing_fullness = fullness;
   }
 
+  // Lets MbedTLS read and write the file descriptor of the underlying TCP
+  // socket directly, instead of shuttling the encrypted data through the
+  // incoming and outgoing byte arrays.  The TCP socket must stay open as
+  // long as this socket is used.
+  void set_direct_fd(int fd);
+  int direct_fd() const { return _direct_fd; }
+
   int outgoing_fullness() const { return _outgoing_fullness; }
   void set_outgoing_fullness(int f) { _outgoing_fullness = f; }
   int from() const { return _incoming_from; }
@@ -105,6 +112,7 @@ class MbedTLSSocket : public BaseMbedTLSSocket {
   int _outgoing_fullness;
   HeapRoot _incoming_packet;  // Blob-compatible or null.
   int _incoming_from;
+  int _direct_fd;
 };
 
 class MbedTLSResourceGroup : public ResourceGroup {
@@ -29,4 +29,7 @@ enum UDPOption {
   UDP_BROADCAST   = 3,
 };
 
+// Maximum number of datagrams sent or received by a single batch call.
+static const int UDP_MAX_BATCH = 32;
+
 } // namespace toit
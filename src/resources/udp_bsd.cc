@@ -361,6 +361,111 @@ PRIMITIVE(close) {
   return process->program()->null_object();
 }
 
+// There is no sendmmsg on BSD, so the datagrams are sent one at a time.
+PRIMITIVE(send_batch) {
+  ARGS(ByteArray, proxy, IntResource, connection_resource, Array, datagrams, Object, addresses, Object, ports);
+  USE(proxy);
+  int fd = connection_resource->id();
+
+  int count = Utils::min(datagrams->length(), UDP_MAX_BATCH);
+
+  Array* address_array = null;
+  Array* port_array = null;
+  if (addresses != process->program()->null_object()) {
+    if (!addresses->is_array() || !ports->is_array()) WRONG_TYPE;
+    address_array = Array::cast(addresses);
+    port_array = Array::cast(ports);
+    if (address_array->length() < count || port_array->length() < count) OUT_OF_BOUNDS;
+  }
+
+  Blob data[UDP_MAX_BATCH];
+  struct sockaddr_in addrs[UDP_MAX_BATCH];
+  for (int i = 0; i < count; i++) {
+    if (!datagrams->at(i)->byte_content(process->program(), &data[i], STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+
+    if (address_array != null) {
+      Blob address_bytes;
+      if (!address_array->at(i)->byte_content(process->program(), &address_bytes, STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+      // TODO: Support IPv6.
+      if (address_bytes.length() != sizeof(addrs[i].sin_addr.s_addr)) INVALID_ARGUMENT;
+      Object* port = port_array->at(i);
+      if (!port->is_smi()) WRONG_TYPE;
+      bzero(&addrs[i], sizeof(addrs[i]));
+      addrs[i].sin_family = AF_INET;
+      memcpy(&addrs[i].sin_addr.s_addr, address_bytes.address(), address_bytes.length());
+      addrs[i].sin_port = htons(Smi::cast(port)->value());
+    }
+  }
+
+  int sent = 0;
+  while (sent < count) {
+    struct sockaddr* addr = null;
+    socklen_t size = 0;
+    if (address_array != null) {
+      addr = reinterpret_cast<struct sockaddr*>(&addrs[sent]);
+      size = sizeof(addrs[sent]);
+    }
+    int wrote = sendto(fd, data[sent].address(), data[sent].length(), 0, addr, size);
+    if (wrote == -1) {
+      // Report the datagrams that were sent.  A persistent error is reported
+      // by the next call.
+      if (sent > 0) break;
+      if (errno == EWOULDBLOCK) return Smi::from(-1);
+      return Primitive::os_error(errno, process);
+    }
+    sent++;
+  }
+
+  return Smi::from(sent);
+}
+
+// There is no recvmmsg on BSD, so the datagrams are received one at a time.
+PRIMITIVE(receive_batch) {
+  ARGS(ByteArray, proxy, IntResource, connection_resource, Array, buffers, Array, output);
+  USE(proxy);
+  int fd = connection_resource->id();
+
+  int count = Utils::min(buffers->length(), UDP_MAX_BATCH);
+  if (output->length() < 3 * count) OUT_OF_BOUNDS;
+
+  MutableBlob data[UDP_MAX_BATCH];
+  ByteArray* address_arrays[UDP_MAX_BATCH];
+  for (int i = 0; i < count; i++) {
+    Error* error = null;
+    if (!buffers->at(i)->mutable_byte_content(process, &data[i], &error)) WRONG_TYPE;
+    if (data[i].address() == null) return error;
+  }
+
+  // Allocate the addresses before receiving, so a failed allocation does not
+  // lose any datagrams.
+  // TODO: Support IPv6.
+  for (int i = 0; i < count; i++) {
+    Error* error = null;
+    address_arrays[i] = process->allocate_byte_array(4, &error);
+    if (address_arrays[i] == null) return error;
+  }
+
+  int received = 0;
+  while (received < count) {
+    struct sockaddr_in addr;
+    bzero(&addr, sizeof(addr));
+    socklen_t addr_len = sizeof(addr);
+    int read = recvfrom(fd, data[received].address(), data[received].length(), 0, reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    if (read == -1) {
+      if (received > 0) break;
+      if (errno == EWOULDBLOCK) return Smi::from(-1);
+      return Primitive::os_error(errno, process);
+    }
+    output->at_put(3 * received, Smi::from(read));
+    memcpy(ByteArray::Bytes(address_arrays[received]).address(), &addr.sin_addr.s_addr, 4);
+    output->at_put(3 * received + 1, address_arrays[received]);
+    output->at_put(3 * received + 2, Smi::from(ntohs(addr.sin_port)));
+    received++;
+  }
+
+  return Smi::from(received);
+}
+
 } // namespace toit
 
 #endif // TOIT_BSD
@@ -439,6 +439,129 @@ PRIMITIVE(set_option) {
   });
 }
 
+PRIMITIVE(send_batch) {
+  ARGS(UDPResourceGroup, resource_group, UDPSocket, socket, Array, datagrams, Object, addresses, Object, ports);
+
+  int count = Utils::min(datagrams->length(), UDP_MAX_BATCH);
+
+  Array* address_array = null;
+  Array* port_array = null;
+  if (addresses != process->program()->null_object()) {
+    if (!addresses->is_array() || !ports->is_array()) WRONG_TYPE;
+    address_array = Array::cast(addresses);
+    port_array = Array::cast(ports);
+    if (address_array->length() < count || port_array->length() < count) OUT_OF_BOUNDS;
+  }
+
+  Blob data[UDP_MAX_BATCH];
+  ip_addr_t addrs[UDP_MAX_BATCH];
+  u16_t port_numbers[UDP_MAX_BATCH];
+  for (int i = 0; i < count; i++) {
+    if (!datagrams->at(i)->byte_content(process->program(), &data[i], STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+
+    if (address_array != null) {
+      Blob address_bytes;
+      if (!address_array->at(i)->byte_content(process->program(), &address_bytes, STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+      // TODO: Support IPv6.
+      if (address_bytes.length() != 4) INVALID_ARGUMENT;
+      const uint8_t* a = address_bytes.address();
+      IP_ADDR4(&addrs[i], a[0], a[1], a[2], a[3]);
+      Object* port = port_array->at(i);
+      if (!port->is_smi()) WRONG_TYPE;
+      port_numbers[i] = Smi::cast(port)->value();
+    }
+  }
+
+  bool has_addresses = address_array != null;
+  CAPTURE4(
+      UDPSocket*, socket,
+      Process*, process,
+      int, count,
+      bool, has_addresses);
+
+  // LwIP has no batch operations, so the datagrams are sent one at a time,
+  // all in a single call on the LwIP thread.
+  return resource_group->event_source()->call_on_thread([&]() -> Object* {
+    for (int i = 0; i < capture.count; i++) {
+      // Like in `send`, a datagram that can't get a buffer is dropped.
+      pbuf* p = pbuf_alloc(PBUF_TRANSPORT, data[i].length(), PBUF_REF);
+      if (p == NULL) continue;
+      p->payload = const_cast<uint8_t*>(data[i].address());
+
+      err_t err;
+      if (capture.has_addresses) {
+        err = udp_sendto(capture.socket->upcb(), p, &addrs[i], port_numbers[i]);
+      } else {
+        err = udp_send(capture.socket->upcb(), p);
+      }
+      pbuf_free(p);
+
+      if (err != ERR_OK && err != ERR_MEM) {
+        // Report the datagrams that were sent.  A persistent error is
+        // reported by the next call.
+        if (i > 0) return Smi::from(i);
+        return lwip_error(capture.process, err);
+      }
+    }
+    return Smi::from(capture.count);
+  });
+}
+
+PRIMITIVE(receive_batch) {
+  ARGS(UDPResourceGroup, resource_group, UDPSocket, socket, Array, buffers, Array, output);
+
+  int count = Utils::min(buffers->length(), UDP_MAX_BATCH);
+  if (output->length() < 3 * count) OUT_OF_BOUNDS;
+
+  MutableBlob data[UDP_MAX_BATCH];
+  for (int i = 0; i < count; i++) {
+    Error* error = null;
+    if (!buffers->at(i)->mutable_byte_content(process, &data[i], &error)) WRONG_TYPE;
+    if (data[i].address() == null) return error;
+  }
+
+  CAPTURE4(
+      Process*, process,
+      UDPSocket*, socket,
+      int, count,
+      Array*, output);
+
+  return resource_group->event_source()->call_on_thread([&]() -> Object* {
+    int received = 0;
+    while (received < capture.count) {
+      Packet* packet = capture.socket->next_packet();
+      if (packet == null) break;
+
+      // Allocate the address before taking the packet, so a failed
+      // allocation does not lose it.
+      // TODO: Support IPv6.
+      Error* error = null;
+      ByteArray* address = capture.process->allocate_byte_array(4, &error);
+      if (address == null) {
+        if (received > 0) break;
+        return error;
+      }
+
+      pbuf* p = packet->pbuf();
+      int length = Utils::min(static_cast<int>(p->len), data[received].length());
+      memcpy(data[received].address(), p->payload, length);
+
+      capture.output->at_put(3 * received, Smi::from(length));
+      ip_addr_t addr = packet->addr();
+      uint32_t ipv4_address = ip_addr_get_ip4_u32(&addr);
+      memcpy(ByteArray::Bytes(address).address(), &ipv4_address, 4);
+      capture.output->at_put(3 * received + 1, address);
+      capture.output->at_put(3 * received + 2, Smi::from(packet->port()));
+
+      capture.socket->take_packet();
+      received++;
+    }
+    if (received == 0) return Smi::from(-1);
+    capture.socket->set_recv();
+    return Smi::from(received);
+  });
+}
+
 } // namespace toit
 
 #endif // defined(TOIT_FREERTOS) || defined(TOIT_USE_LWIP)
@@ -26,6 +26,7 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "../objects.h"
@@ -242,6 +243,112 @@ PRIMITIVE(send) {
   return Smi::from(wrote);
 }
 
+PRIMITIVE(send_batch) {
+  ARGS(ByteArray, proxy, IntResource, connection_resource, Array, datagrams, Object, addresses, Object, ports);
+  USE(proxy);
+  int fd = connection_resource->id();
+
+  int count = Utils::min(datagrams->length(), UDP_MAX_BATCH);
+
+  Array* address_array = null;
+  Array* port_array = null;
+  if (addresses != process->program()->null_object()) {
+    if (!addresses->is_array() || !ports->is_array()) WRONG_TYPE;
+    address_array = Array::cast(addresses);
+    port_array = Array::cast(ports);
+    if (address_array->length() < count || port_array->length() < count) OUT_OF_BOUNDS;
+  }
+
+  struct mmsghdr messages[UDP_MAX_BATCH];
+  struct iovec iov[UDP_MAX_BATCH];
+  struct sockaddr_in addrs[UDP_MAX_BATCH];
+  memset(messages, 0, sizeof(messages));
+
+  for (int i = 0; i < count; i++) {
+    Blob data;
+    if (!datagrams->at(i)->byte_content(process->program(), &data, STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+    iov[i].iov_base = const_cast<uint8*>(data.address());
+    iov[i].iov_len = data.length();
+    messages[i].msg_hdr.msg_iov = &iov[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+
+    if (address_array != null) {
+      Blob address_bytes;
+      if (!address_array->at(i)->byte_content(process->program(), &address_bytes, STRINGS_OR_BYTE_ARRAYS)) WRONG_TYPE;
+      // TODO: Support IPv6.
+      if (address_bytes.length() != sizeof(addrs[i].sin_addr.s_addr)) INVALID_ARGUMENT;
+      Object* port = port_array->at(i);
+      if (!port->is_smi()) WRONG_TYPE;
+      bzero(&addrs[i], sizeof(addrs[i]));
+      addrs[i].sin_family = AF_INET;
+      memcpy(&addrs[i].sin_addr.s_addr, address_bytes.address(), address_bytes.length());
+      addrs[i].sin_port = htons(Smi::cast(port)->value());
+      messages[i].msg_hdr.msg_name = &addrs[i];
+      messages[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+  }
+
+  int sent = sendmmsg(fd, messages, count, 0);
+  if (sent == -1) {
+    if (errno == EWOULDBLOCK) return Smi::from(-1);
+    return Primitive::os_error(errno, process);
+  }
+
+  return Smi::from(sent);
+}
+
+PRIMITIVE(receive_batch) {
+  ARGS(ByteArray, proxy, IntResource, connection_resource, Array, buffers, Array, output);
+  USE(proxy);
+  int fd = connection_resource->id();
+
+  int count = Utils::min(buffers->length(), UDP_MAX_BATCH);
+  if (output->length() < 3 * count) OUT_OF_BOUNDS;
+
+  struct mmsghdr messages[UDP_MAX_BATCH];
+  struct iovec iov[UDP_MAX_BATCH];
+  struct sockaddr_in addrs[UDP_MAX_BATCH];
+  ByteArray* address_arrays[UDP_MAX_BATCH];
+  memset(messages, 0, sizeof(messages));
+
+  for (int i = 0; i < count; i++) {
+    MutableBlob buffer;
+    Error* error = null;
+    if (!buffers->at(i)->mutable_byte_content(process, &buffer, &error)) WRONG_TYPE;
+    if (buffer.address() == null) return error;
+    iov[i].iov_base = buffer.address();
+    iov[i].iov_len = buffer.length();
+    messages[i].msg_hdr.msg_iov = &iov[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+    messages[i].msg_hdr.msg_name = &addrs[i];
+    messages[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+  }
+
+  // Allocate the addresses before receiving, so a failed allocation does not
+  // lose any datagrams.
+  // TODO: Support IPv6.
+  for (int i = 0; i < count; i++) {
+    Error* error = null;
+    address_arrays[i] = process->allocate_byte_array(4, &error);
+    if (address_arrays[i] == null) return error;
+  }
+
+  int received = recvmmsg(fd, messages, count, 0, null);
+  if (received == -1) {
+    if (errno == EWOULDBLOCK) return Smi::from(-1);
+    return Primitive::os_error(errno, process);
+  }
+
+  for (int i = 0; i < received; i++) {
+    output->at_put(3 * i, Smi::from(messages[i].msg_len));
+    memcpy(ByteArray::Bytes(address_arrays[i]).address(), &addrs[i].sin_addr.s_addr, 4);
+    output->at_put(3 * i + 1, address_arrays[i]);
+    output->at_put(3 * i + 2, Smi::from(ntohs(addrs[i].sin_port)));
+  }
+
+  return Smi::from(received);
+}
+
 static Object* get_address_or_error(int id, Process* process, bool peer) {
   struct sockaddr_in sin;
   socklen_t len = sizeof(sin);
@@ -43,17 +43,31 @@ void SchedulerThread::entry() {
 
 Scheduler::Scheduler()
     : _mutex(OS::allocate_mutex(2, "Scheduler"))
-    , _has_processes(OS::allocate_condition_variable(_mutex))
     , _has_threads(OS::allocate_condition_variable(_mutex))
     , _gc_condition(OS::allocate_condition_variable(_mutex))
     , _gc_cross_processes(false)
     , _gc_waiting_for_preemption(0)
+    , _gc_pending_scavenges(0)
+    , _gc_cross_process_count(0)
+    , _gc_cross_process_scavenges(0)
+    , _gc_idle_thread_scavenges(0)
+    , _gc_cross_process_total_us(0)
+    , _gc_cross_process_max_us(0)
     , _num_processes(0)
     , _next_group_id(0)
     , _next_process_id(0)
+    , _num_ready_processes(0)
+    , _min_vruntime(0)
     , _num_threads(0)
-    , _max_threads(OS::num_cores())
+    , _max_threads(Flags::scheduler_threads > 0 ? Flags::scheduler_threads : OS::num_cores())
+    , _num_idle_threads(0)
+    , _fast_tick_requested(false)
+    , _lookup_epoch(0)
+    , _reclaim_mutex(OS::allocate_mutex(3, "Process reclamation"))
+    , _reclaim_condition(OS::allocate_condition_variable(_reclaim_mutex))
     , _boot_process(null) {
+  _lookups[0] = 0;
+  _lookups[1] = 0;
   Locker locker(_mutex);
 #ifdef TOIT_FREERTOS
   // On FreeRTOS we immediately start two threads (the main one and a second
@@ -69,9 +83,10 @@ Scheduler::~Scheduler() {
   ASSERT(_groups.is_empty());
   ASSERT(_ready_processes.is_empty());
   ASSERT(_threads.is_empty());
+  OS::dispose(_reclaim_condition);
+  OS::dispose(_reclaim_mutex);
   OS::dispose(_gc_condition);
   OS::dispose(_has_threads);
-  OS::dispose(_has_processes);
   OS::dispose(_mutex);
 }
 
@@ -116,6 +131,7 @@ Scheduler::ExitState Scheduler::launch_program(Locker& locker, Process* process)
 
   // Update the state and start the boot process.
   ASSERT(_groups.is_empty() && _boot_process == null);
+  if (!_process_table.ensure_capacity()) FATAL("Cannot allocate process table");
   _groups.prepend(group);
   _boot_process = process;
   add_process(locker, process);
@@ -125,8 +141,13 @@ Scheduler::ExitState Scheduler::launch_program(Locker& locker, Process* process)
   while (_num_processes > 0 && _num_threads > 0) {
     int64 time = OS::get_monotonic_time();
     if (time >= next_tick_time) {
-      next_tick_time = time + Scheduler::TICK_PERIOD_US;
-      tick(locker);
+      bool fast = tick(locker);
+      next_tick_time = time + (fast ? TICK_PERIOD_US : IDLE_TICK_PERIOD_US);
+    } else if (_num_ready_processes > 0 || _fast_tick_requested) {
+      // A process became ready while all threads were busy, or a process
+      // started sampling, so the short tick is needed again.
+      _fast_tick_requested = false;
+      next_tick_time = Utils::min(next_tick_time, time + TICK_PERIOD_US);
     }
     ASSERT(time < next_tick_time);
     int delay_ms = 1 + ((next_tick_time - time - 1) / 1000); // Ceiling division.
@@ -146,7 +167,9 @@ Scheduler::ExitState Scheduler::launch_program(Locker& locker, Process* process)
 
   while (ProcessGroup* group = _groups.remove_first()) {
     while (Process* process = group->processes().remove_first()) {
+      _process_table.remove(process);
       Unlocker unlock(locker);
+      wait_for_lookups();
       delete process;
     }
     delete group;
@@ -162,6 +185,7 @@ int Scheduler::next_group_id() {
 
 int Scheduler::run_program(Program* program, char** args, ProcessGroup* group, Block* initial_block) {
   Locker locker(_mutex);
+  if (!_process_table.ensure_capacity()) return INVALID_PROCESS_ID;
   Process* process = _new Process(program, group, args, initial_block);
   if (process == null) return INVALID_PROCESS_ID;
   Interpreter interpreter;
@@ -180,23 +204,34 @@ scheduler_err_t Scheduler::send_system_message(SystemMessage* message) {
 }
 
 scheduler_err_t Scheduler::send_message(ProcessGroup* group, int process_id, Message* message) {
-  Locker locker(_mutex);
-  Process* p = group->lookup(process_id);
-  if (p == null) return MESSAGE_NO_SUCH_RECEIVER;
-  p->_append_message(message);
-  process_ready(locker, p);
-  return MESSAGE_OK;
+  LookupScope scope(this);
+  Process* p = _process_table.lookup(process_id);
+  if (p == null || p->group() != group) return MESSAGE_NO_SUCH_RECEIVER;
+  return deliver_message(p, message);
 }
 
 scheduler_err_t Scheduler::send_message(int process_id, Message* message) {
-  Locker locker(_mutex);
-  Process* p = find_process(locker, process_id);
+  LookupScope scope(this);
+  Process* p = _process_table.lookup(process_id);
   if (p == null) return MESSAGE_NO_SUCH_RECEIVER;
-  p->_append_message(message);
-  process_ready(locker, p);
+  return deliver_message(p, message);
+}
+
+scheduler_err_t Scheduler::deliver_message(Process* process, Message* message) {
+  if (process->_append_message(message)) message_sent(process);
   return MESSAGE_OK;
 }
 
+void Scheduler::message_sent(Process* process) {
+  // A running or scheduled process checks its mailbox after it has marked
+  // itself idle (see [run_process]), so only idle or suspended processes
+  // need the scheduler lock to be made ready.
+  Process::State state = process->state();
+  if (state == Process::RUNNING || state == Process::SCHEDULED) return;
+  Locker locker(_mutex);
+  process_ready(locker, process);
+}
+
 scheduler_err_t Scheduler::send_system_message(Locker& locker, SystemMessage* message) {
   if (_boot_process != null) {
     _boot_process->_append_message(message);
@@ -239,6 +274,7 @@ bool Scheduler::signal_process(Process* sender, int target_id, Process::Signal s
 
 Process* Scheduler::hatch(Program* program, ProcessGroup* process_group, Method method, const uint8* array_address, int array_length, Block* initial_block) {
   Locker locker(_mutex);
+  if (!_process_table.ensure_capacity()) return null;
 
   Process* process = _new Process(program, process_group, method, array_address, array_length, initial_block);
   if (!process) return null;
@@ -277,24 +313,43 @@ void Scheduler::run(SchedulerThread* scheduler_thread) {
   // all OS threads at startup on platforms that may have a hard time starting
   // such threads later due to memory pressure.
   while (!has_exit_reason()) {
-    if (_ready_processes.is_empty()) {
-      OS::wait(_has_processes);
+    if (!_gc_targets.is_empty()) {
+      if (scheduler_thread->_is_idle) {
+        scheduler_thread->_is_idle = false;
+        _num_idle_threads--;
+      }
+      scavenge_target(locker, _gc_targets.remove_first(), true);
+      continue;
+    }
+    Process* process = next_ready_process(locker, scheduler_thread);
+    if (process == null) {
+      if (!scheduler_thread->_is_idle) {
+        scheduler_thread->_is_idle = true;
+        _num_idle_threads++;
+      }
+      OS::wait(scheduler_thread->_has_processes);
       continue;
     }
-
-    Process* process = _ready_processes.remove_first();
     ASSERT(process->state() == Process::SCHEDULED);
 
-    if (!_ready_processes.is_empty()) {
+    if (scheduler_thread->_is_idle) {
+      // We were not woken by anybody, e.g. because of a spurious wakeup.
+      scheduler_thread->_is_idle = false;
+      _num_idle_threads--;
+    }
+
+    if (_num_ready_processes > 0) {
       // Notify potential other thread that there are more processes ready.
-      OS::signal(_has_processes);
+      wake_idle_thread(locker, null);
     }
 
     run_process(locker, process, scheduler_thread);
   }
 
-  // Notify potential other thread, that no more processes are left.
-  OS::signal(_has_processes);
+  if (scheduler_thread->_is_idle) {
+    scheduler_thread->_is_idle = false;
+    _num_idle_threads--;
+  }
 
   _num_threads--;
 
@@ -386,34 +441,77 @@ void Scheduler::scavenge(Process* process, bool malloc_failed, bool try_hard) {
       }
     }
 
-    for (Process* target : targets) {
-      target->scavenge();
+    // The heaps of the targets are independent, so we hand them to the idle
+    // scheduler threads and scavenge the rest on this thread.  If the free
+    // list cannot cover another scavenge, HeapMemory::enter_scavenge makes it
+    // wait for the ones in progress, so they run one at a time.
+    Locker locker(_mutex);
+    while (!targets.is_empty()) {
+      _gc_targets.append(targets.remove_first());
+      _gc_pending_scavenges++;
       scavenges++;
+      wake_idle_thread(locker, null);
     }
-
-    { Locker locker(_mutex);
-      while (!targets.is_empty()) {
-        Process* target = targets.remove_first();
-        if (target->state() != Process::SUSPENDED_AWAITING_GC) {
-          scavenge_resume_process(locker, target);
-        }
-      }
+    while (!_gc_targets.is_empty()) {
+      scavenge_target(locker, _gc_targets.remove_first(), false);
     }
   }
 
   process->scavenge();
 
+  Locker locker(_mutex);
+  if (doing_idle_process_gc) {
+    // Wait for the idle threads to complete the scavenges they took.  They
+    // may also be working for another thread that started a GC at the same
+    // time, so we keep helping with those while we wait.
+    while (_gc_pending_scavenges > 0) {
+      if (!_gc_targets.is_empty()) {
+        scavenge_target(locker, _gc_targets.remove_first(), false);
+      } else {
+        OS::wait(_gc_condition);
+      }
+    }
+  }
   if (doing_cross_process_gc) {
-    Locker locker(_mutex);
     _gc_cross_processes = false;
+    int64 pause_us = OS::get_monotonic_time() - start;
+    _gc_cross_process_count++;
+    _gc_cross_process_scavenges += scavenges + 1;
+    _gc_cross_process_total_us += pause_us;
+    _gc_cross_process_max_us = Utils::max(_gc_cross_process_max_us, pause_us);
 #ifdef TOIT_FREERTOS
-    printf("[cross-process gc: %d scavenges, took %Ld ms]\n",
-        scavenges + 1, (OS::get_monotonic_time() - start) / 1000);
+    const bool print = true;
+#else
+    const bool print = Flags::tracegc;
 #endif
+    if (print) {
+      printf("[cross-process gc: %d scavenges, took %lld.%03lld ms]\n",
+          scavenges + 1, pause_us / 1000, pause_us % 1000);
+    }
     OS::signal_all(_gc_condition);
   }
 }
 
+void Scheduler::scavenge_target(Locker& locker, Process* target, bool on_idle_thread) {
+  { Unlocker unlocker(locker);
+    target->scavenge();
+  }
+  if (target->state() != Process::SUSPENDED_AWAITING_GC) {
+    scavenge_resume_process(locker, target);
+  }
+  if (on_idle_thread) _gc_idle_thread_scavenges++;
+  if (--_gc_pending_scavenges == 0) OS::signal_all(_gc_condition);
+}
+
+void Scheduler::gc_stats(int64* stats) {
+  Locker locker(_mutex);
+  stats[0] = _gc_cross_process_count;
+  stats[1] = _gc_cross_process_scavenges;
+  stats[2] = _gc_idle_thread_scavenges;
+  stats[3] = _gc_cross_process_total_us;
+  stats[4] = _gc_cross_process_max_us;
+}
+
 void Scheduler::print_stack_traces() {
   Locker locker(_mutex);
   Interpreter interpreter;
@@ -431,13 +529,14 @@ void Scheduler::print_stack_traces() {
 }
 
 void Scheduler::add_process(Locker& locker, Process* process) {
+  _process_table.add(process);
   _num_processes++;
   process_ready(locker, process);
   start_thread(locker, ONLY_IF_PROCESSES_ARE_READY);
 }
 
 bool Scheduler::process_stats(Array* array, int group_id, int process_id) {
-  ASSERT(array->length() == 7);
+  ASSERT(array->length() == PROCESS_STATS_LENGTH);
   Locker locker(_mutex);
   ProcessGroup* group = null;
   for (auto g : _groups) {
@@ -453,6 +552,18 @@ bool Scheduler::process_stats(Array* array, int group_id, int process_id) {
   array->at_put(4, Smi::from(process->object_heap()->total_bytes_allocated()));
   array->at_put(5, Smi::from(group_id));
   array->at_put(6, Smi::from(process_id));
+  array->at_put(7, Smi::from(process->priority()));
+  for (int i = 0; i < Process::LATENCY_BUCKETS; i++) {
+    array->at_put(8 + i, Smi::from(process->scheduling_latency_count(i)));
+  }
+  return true;
+}
+
+bool Scheduler::set_priority(ProcessGroup* group, int process_id, int priority) {
+  Locker locker(_mutex);
+  Process* process = group->lookup(process_id);
+  if (process == null) return false;
+  process->set_priority(priority);
   return true;
 }
 
@@ -466,6 +577,7 @@ void Scheduler::run_process(Locker& locker, Process* process, SchedulerThread* s
 
   int64 start = OS::get_monotonic_time();
   process->set_last_run(start);
+  process->record_scheduling_latency(start - process->ready_since());
 
   Interpreter::Result result(Interpreter::Result::PREEMPTED);
   // If no signals are sent, run the process.
@@ -474,7 +586,9 @@ void Scheduler::run_process(Locker& locker, Process* process, SchedulerThread* s
     result = interpreter->run();
   }
 
-  process->increment_unyielded_for(OS::get_monotonic_time() - start);
+  int64 duration = OS::get_monotonic_time() - start;
+  process->increment_unyielded_for(duration);
+  process->account_run(duration);
 
   while (result.state() != Interpreter::Result::TERMINATED) {
     uint32_t signals = process->signals();
@@ -491,6 +605,10 @@ void Scheduler::run_process(Locker& locker, Process* process, SchedulerThread* s
       process->clear_signal(Process::PRINT_STACK_TRACE);
     } else if (signals & Process::WATCHDOG) {
       process->clear_signal(Process::WATCHDOG);
+    } else if (signals & Process::PROFILE_SAMPLE) {
+      SamplingProfiler* profiler = process->sampling_profiler();
+      if (profiler != null) profiler->sample(process->task()->stack(), process->program());
+      process->clear_signal(Process::PROFILE_SAMPLE);
     } else {
       UNREACHABLE();
     }
@@ -522,12 +640,18 @@ void Scheduler::run_process(Locker& locker, Process* process, SchedulerThread* s
       ProcessGroup* group = process->group();
       bool last_in_group = !group->remove(process);
       ASSERT(group->lookup(process->id()) == null);
+      _process_table.remove(process);
+      ProcessTable::Table* retired = _process_table.take_retired();
 
       // Deleting processes might need to take the event source lock, so we have
       // to unlock the scheduler to not get into a deadlock with the delivery of
       // an asynchronous event that needs to call [process_ready] and thus also
       // take the scheduler lock.
+      // Senders look processes up without the lock, so wait for the ones that
+      // might still see this process (or the retired tables) before freeing.
       { Unlocker unlock(locker);
+        wait_for_lookups();
+        ProcessTable::free_tables(retired);
         delete process;
       }
 
@@ -564,7 +688,7 @@ void Scheduler::scavenge_suspend_process(Locker& locker, Process* process) {
     process->set_state(Process::SUSPENDED_IDLE);
   } else if (process->state() == Process::SCHEDULED) {
     process->set_state(Process::SUSPENDED_SCHEDULED);
-    _ready_processes.remove(process);
+    remove_ready_process(locker, process);
   }
   ASSERT(process->is_suspended());
 }
@@ -592,10 +716,12 @@ void Scheduler::wait_for_any_gc_to_complete(Locker& locker, Process* process, Pr
 }
 
 void Scheduler::start_thread(Locker& locker, StartThreadRule force) {
-  if (force == ONLY_IF_PROCESSES_ARE_READY && _ready_processes.is_empty()) return;
+  if (force == ONLY_IF_PROCESSES_ARE_READY && _num_ready_processes == 0) return;
   if (_num_threads == _max_threads) return;
 
-  SchedulerThread* new_thread = _new SchedulerThread(this);
+  ConditionVariable* has_processes = OS::allocate_condition_variable(_mutex);
+  if (has_processes == null) FATAL("OS thread spawn failed");
+  SchedulerThread* new_thread = _new SchedulerThread(this, has_processes);
   // On FreeRTOS we start both threads at boot time with the
   // EVEN_IF_PROCESSES_NOT_READY flag and then don't start other
   // threads. This should be enough, and should ensure that allocation
@@ -626,11 +752,109 @@ void Scheduler::process_ready(Locker& locker, Process* process) {
     return;
   }
   process->set_state(Process::SCHEDULED);
+  process->set_ready_since(OS::get_monotonic_time());
+  _num_ready_processes++;
+
+  // Processes that have been idle for a while only get a limited credit, so
+  // they cannot monopolize the threads when they wake up.
+  int64 floor = _min_vruntime - time_slice_us(process);
+  if (process->vruntime() < floor) process->set_vruntime(floor);
+
+  // A process that is made ready by another process, e.g. by receiving a
+  // message from it, is queued on the thread of that process.  This keeps
+  // communicating processes on the same core, and avoids waking up other
+  // threads unless they are idle and can steal the work.
+  SchedulerThread* thread = current_scheduler_thread(locker);
+  if (thread != null) {
+    enqueue(&thread->_ready_processes, process);
+    thread->_ready_count++;
+  } else {
+    enqueue(&_ready_processes, process);
+  }
+  // If no thread can take the process, the launch thread may have to switch
+  // to the short tick to preempt a running process.
+  if (_num_idle_threads == 0) OS::signal(_has_threads);
+  wake_idle_thread(locker, thread);
+}
+
+SchedulerThread* Scheduler::current_scheduler_thread(Locker& locker) {
+  Thread* current = Thread::current();
+  for (SchedulerThread* thread : _threads) {
+    if (thread == current) return thread;
+  }
+  return null;
+}
+
+bool Scheduler::runs_before(Process* a, Process* b) {
+  if (!Flags::fifo_scheduling && a->vruntime() != b->vruntime()) {
+    return a->vruntime() < b->vruntime();
+  }
+  return a->ready_since() <= b->ready_since();
+}
+
+Process* Scheduler::next_ready_process(Locker& locker, SchedulerThread* scheduler_thread) {
+  if (_num_ready_processes == 0) return null;
+
+  Process* process = null;
+  Process* local = scheduler_thread->_ready_processes.first();
+  Process* global = _ready_processes.first();
+  // Preempted processes go back on the local queue, and processes woken by
+  // events go on the global queue, so neither queue can be drained first
+  // without starving the other.
+  if (local != null && (global == null || runs_before(local, global))) {
+    process = scheduler_thread->_ready_processes.remove_first();
+    scheduler_thread->_ready_count--;
+  } else if (global != null) {
+    process = _ready_processes.remove_first();
+  } else {
+    // Steal from the thread with the longest queue.
+    SchedulerThread* victim = null;
+    for (SchedulerThread* thread : _threads) {
+      if (thread->_ready_count > 0 && (victim == null || thread->_ready_count > victim->_ready_count)) {
+        victim = thread;
+      }
+    }
+    if (victim == null) return null;
+    process = victim->_ready_processes.remove_first();
+    victim->_ready_count--;
+  }
+
+  _num_ready_processes--;
+  _min_vruntime = Utils::max(_min_vruntime, process->vruntime());
+  return process;
+}
 
-  if (_ready_processes.is_empty()) {
-    OS::signal(_has_processes);
+void Scheduler::remove_ready_process(Locker& locker, Process* process) {
+  if (_ready_processes.remove(process) == null) {
+    for (SchedulerThread* thread : _threads) {
+      if (thread->_ready_processes.remove(process) != null) {
+        thread->_ready_count--;
+        break;
+      }
+    }
   }
-  _ready_processes.append(process);
+  _num_ready_processes--;
+}
+
+void Scheduler::wake_idle_thread(Locker& locker, SchedulerThread* preferred) {
+  if (_num_idle_threads == 0) return;
+  if (preferred != null && preferred->_is_idle) {
+    wake_thread(locker, preferred);
+    return;
+  }
+  for (SchedulerThread* thread : _threads) {
+    if (thread->_is_idle) {
+      wake_thread(locker, thread);
+      return;
+    }
+  }
+}
+
+void Scheduler::wake_thread(Locker& locker, SchedulerThread* thread) {
+  ASSERT(thread->_is_idle);
+  thread->_is_idle = false;
+  _num_idle_threads--;
+  OS::signal(thread->_has_processes);
 }
 
 void Scheduler::print_process(Locker& locker, Process* process, Interpreter* interpreter) {
@@ -679,7 +903,9 @@ void Scheduler::terminate_execution(Locker& locker, ExitState exit) {
     }
   }
 
-  OS::signal(_has_processes);
+  for (SchedulerThread* thread : _threads) {
+    if (thread->_is_idle) wake_thread(locker, thread);
+  }
 }
 
 word Scheduler::largest_number_of_blocks_in_a_process() {
@@ -691,8 +917,9 @@ word Scheduler::largest_number_of_blocks_in_a_process() {
   return largest;
 }
 
-void Scheduler::tick(Locker& locker) {
+bool Scheduler::tick(Locker& locker) {
   int64 now = OS::get_monotonic_time();
+  bool sampling = false;
 
   for (SchedulerThread* thread : _threads) {
     Process* process = thread->interpreter()->process();
@@ -702,25 +929,180 @@ void Scheduler::tick(Locker& locker) {
     if (runtime > WATCHDOG_PERIOD_US) {
       process->signal(Process::WATCHDOG);
     }
+    if (process->is_sampling()) {
+      process->signal(Process::PROFILE_SAMPLE);
+      sampling = true;
+    }
   }
 
-  if (_ready_processes.is_empty()) return;
+  if (_num_ready_processes == 0) return sampling;
 
+  // Only preempt processes that have used up their time slice.
   for (SchedulerThread* thread : _threads) {
     Process* process = thread->interpreter()->process();
-    if (process != null) {
+    if (process != null && process->current_slice_duration(now) >= time_slice_us(process)) {
       process->signal(Process::PREEMPT);
     }
   }
+  return true;
 }
 
-Process* Scheduler::find_process(Locker& locker, int process_id) {
-  for (ProcessGroup* group : _groups) {
-    Process* p = group->lookup(process_id);
-    if (p != null) return p;
+int64 Scheduler::time_slice_us(Process* process) {
+  int64 slice = Flags::time_slice_ms * 1000LL * process->priority() / Process::DEFAULT_PRIORITY;
+  return Utils::max(slice, 1000LL);
+}
+
+void Scheduler::enqueue(ProcessListFromScheduler* queue, Process* process) {
+  if (Flags::fifo_scheduling) {
+    queue->append(process);
+    return;
   }
+  // Keep the queue sorted by virtual runtime, and FIFO for equal runtimes.
+  int64 vruntime = process->vruntime();
+  queue->insert_before(process, [vruntime](Process* other) { return other->vruntime() > vruntime; });
+}
 
-  return null;
+void Scheduler::sampling_started() {
+  Locker locker(_mutex);
+  _fast_tick_requested = true;
+  OS::signal(_has_threads);
+}
+
+Scheduler::LookupScope::LookupScope(Scheduler* scheduler) : _scheduler(scheduler) {
+  // Register in the current epoch.  If the epoch changed while we did that
+  // the reclaimer might already be past the check, so try again.
+  while (true) {
+    _epoch = scheduler->_lookup_epoch;
+    scheduler->_lookups[_epoch & 1]++;
+    if (scheduler->_lookup_epoch == _epoch) return;
+    leave();
+  }
+}
+
+Scheduler::LookupScope::~LookupScope() {
+  leave();
+}
+
+void Scheduler::LookupScope::leave() {
+  if (--_scheduler->_lookups[_epoch & 1] != 0) return;
+  if (_scheduler->_lookup_epoch == _epoch) return;
+  // Take the lock, so the signal can't get in between the reclaimer's check
+  // of the count and its wait.
+  OS::lock(_scheduler->_reclaim_mutex);
+  OS::signal(_scheduler->_reclaim_condition);
+  OS::unlock(_scheduler->_reclaim_mutex);
+}
+
+void Scheduler::wait_for_lookups() {
+  // New lookups start in the next epoch, and can no longer find what was
+  // removed from the table, so we only wait for the old epoch to drain.
+  OS::lock(_reclaim_mutex);
+  uword epoch = _lookup_epoch++;
+  while (_lookups[epoch & 1] != 0) {
+    OS::wait(_reclaim_condition);
+  }
+  OS::unlock(_reclaim_mutex);
+}
+
+Process* const ProcessTable::REMOVED = reinterpret_cast<Process*>(1);
+
+ProcessTable::~ProcessTable() {
+  free_tables(_retired);
+  Table* table = _table;
+  if (table != null) free(table);
+}
+
+Process* ProcessTable::lookup(int process_id) const {
+  Table* table = _table;
+  if (table == null) return null;
+  std::atomic<Process*>* slots = table->slots();
+  for (uword i = static_cast<uword>(process_id) & table->mask; true; i = (i + 1) & table->mask) {
+    Process* p = slots[i];
+    if (p == null) return null;
+    if (p != REMOVED && p->id() == process_id) return p;
+  }
+}
+
+bool ProcessTable::ensure_capacity() {
+  // Keep at least half the slots empty so probe sequences stay short and
+  // lookups always terminate.
+  Table* old_table = _table;
+  uword capacity = old_table == null ? 0 : old_table->mask + 1;
+  if (static_cast<uword>(_live + _removed + 1) * 2 <= capacity) return true;
+
+  uword new_capacity = 16;
+  while (new_capacity < static_cast<uword>(_live + 1) * 4) new_capacity *= 2;
+  Table* table = allocate_table(new_capacity);
+  if (table == null) return false;
+  if (old_table != null) {
+    std::atomic<Process*>* old_slots = old_table->slots();
+    std::atomic<Process*>* slots = table->slots();
+    for (uword i = 0; i < capacity; i++) {
+      Process* p = old_slots[i];
+      if (p == null || p == REMOVED) continue;
+      uword j = static_cast<uword>(p->id()) & table->mask;
+      while (slots[j] != null) j = (j + 1) & table->mask;
+      slots[j] = p;
+    }
+    old_table->next_retired = _retired;
+    _retired = old_table;
+  }
+  _removed = 0;
+  _table = table;
+  return true;
+}
+
+void ProcessTable::add(Process* process) {
+  Table* table = _table;
+  ASSERT(table != null && static_cast<uword>(_live + _removed + 1) * 2 <= table->mask + 1);
+  std::atomic<Process*>* slots = table->slots();
+  uword i = static_cast<uword>(process->id()) & table->mask;
+  while (true) {
+    Process* p = slots[i];
+    if (p == null) break;
+    if (p == REMOVED) {
+      _removed--;
+      break;
+    }
+    i = (i + 1) & table->mask;
+  }
+  slots[i] = process;
+  _live++;
+}
+
+void ProcessTable::remove(Process* process) {
+  Table* table = _table;
+  std::atomic<Process*>* slots = table->slots();
+  uword i = static_cast<uword>(process->id()) & table->mask;
+  while (slots[i] != process) {
+    ASSERT(slots[i] != null);
+    i = (i + 1) & table->mask;
+  }
+  slots[i] = REMOVED;
+  _live--;
+  _removed++;
+}
+
+ProcessTable::Table* ProcessTable::allocate_table(uword capacity) {
+  ASSERT(Utils::is_power_of_two(capacity));
+  void* memory = malloc(sizeof(Table) + capacity * sizeof(std::atomic<Process*>));
+  if (memory == null) return null;
+  Table* table = new (memory) Table();
+  table->mask = capacity - 1;
+  table->next_retired = null;
+  std::atomic<Process*>* slots = table->slots();
+  for (uword i = 0; i < capacity; i++) {
+    new (&slots[i]) std::atomic<Process*>(null);
+  }
+  return table;
+}
+
+void ProcessTable::free_tables(Table* tables) {
+  while (tables != null) {
+    Table* next = tables->next_retired;
+    free(tables);
+    tables = next;
+  }
 }
 
 } // namespace toit
@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "linked.h"
 #include "os.h"
 #include "process.h"
@@ -34,11 +36,14 @@ enum scheduler_err_t : int {
 
 class SchedulerThread : public Thread, public SchedulerThreadList::Element {
  public:
-  explicit SchedulerThread(Scheduler* scheduler)
+  SchedulerThread(Scheduler* scheduler, ConditionVariable* has_processes)
       : Thread("Toit")
-      , _scheduler(scheduler) {}
+      , _scheduler(scheduler)
+      , _has_processes(has_processes) {}
 
-  ~SchedulerThread() {}
+  ~SchedulerThread() {
+    OS::dispose(_has_processes);
+  }
 
   Interpreter* interpreter() { return &_interpreter; }
 
@@ -47,6 +52,66 @@ class SchedulerThread : public Thread, public SchedulerThreadList::Element {
  private:
   Scheduler* const _scheduler;
   Interpreter _interpreter;
+
+  // Local run queue.  Processes made ready by this thread, e.g. by sending
+  // them a message, are queued here so they tend to run on the same thread.
+  // Idle threads steal from the other queues.  Guarded by the scheduler mutex.
+  ProcessListFromScheduler _ready_processes;
+  int _ready_count = 0;
+
+  // Set while the thread waits for processes and nobody has woken it yet.
+  bool _is_idle = false;
+  ConditionVariable* const _has_processes;
+
+  friend class Scheduler;
+};
+
+// Maps process ids to live processes in constant time.  The table is an
+// open-addressing hash table that is modified with the scheduler lock held,
+// but can be read without it.  Readers must be inside a LookupScope, which
+// keeps both the processes they find and replaced tables alive.
+class ProcessTable {
+ public:
+  ProcessTable() {}
+  ~ProcessTable();
+
+  // Can be called without the scheduler lock.
+  Process* lookup(int process_id) const;
+
+  // Makes room for one more process.  Returns false on allocation failure.
+  bool ensure_capacity();
+  // Must be preceded by a successful call to ensure_capacity.
+  void add(Process* process);
+  void remove(Process* process);
+
+  class Table {
+   public:
+    uword mask;
+    Table* next_retired;
+    std::atomic<Process*>* slots() {
+      return reinterpret_cast<std::atomic<Process*>*>(this + 1);
+    }
+  };
+
+  // Takes the tables that were replaced since the last call.  They can be
+  // freed once the readers that might be using them are gone.
+  Table* take_retired() {
+    Table* result = _retired;
+    _retired = null;
+    return result;
+  }
+  static void free_tables(Table* tables);
+
+ private:
+  // Marks a slot whose process was removed.
+  static Process* const REMOVED;
+
+  std::atomic<Table*> _table { null };
+  Table* _retired = null;
+  word _live = 0;
+  word _removed = 0;
+
+  static Table* allocate_table(uword capacity);
 };
 
 class Scheduler {
@@ -94,6 +159,10 @@ class Scheduler {
   // Send message to the process by id. Returns an error code to signal whether the message was delivered.
   scheduler_err_t send_message(int process_id, Message* message);
 
+  // Wakes up the process after a message was added to its mailbox.  Only
+  // takes the scheduler lock if the process may be idle.
+  void message_sent(Process* process);
+
   // Send a signal to a target process. Returns true if sender was able to
   // deliver the signal.
   bool signal_process(Process* sender, int target_id, Process::Signal signal);
@@ -126,10 +195,25 @@ class Scheduler {
 
   // Primitive support.
 
-  // Fills in an array of length 3 with stats for the process with the given ids.
-  // Returns false if the process doesn't exist, true otherwise.
+  // Fills in an array of length PROCESS_STATS_LENGTH with stats for the process
+  // with the given ids.  Returns false if the process doesn't exist, true otherwise.
+  static const int PROCESS_STATS_LENGTH = 8 + Process::LATENCY_BUCKETS;
   bool process_stats(Array* array, int group_id, int process_id);
 
+  // Sets the scheduling priority of the process with the given id in the
+  // group.  Returns false if the process doesn't exist, true otherwise.
+  bool set_priority(ProcessGroup* group, int process_id, int priority);
+
+  // Fills in GC_STATS_LENGTH stats for the cross-process GCs: the number of
+  // GCs, the number of scavenges they did, how many of the scavenges ran on
+  // idle scheduler threads, and the total and longest pause in microseconds.
+  static const int GC_STATS_LENGTH = 5;
+  void gc_stats(int64* stats);
+
+  // Called when a process starts sampling, so the launch thread switches to
+  // the short tick right away instead of after the current idle tick.
+  void sampling_started();
+
   word largest_number_of_blocks_in_a_process();
 
   static const int INVALID_PROCESS_ID = -1;
@@ -157,6 +241,10 @@ class Scheduler {
   // waiting transition to the new state.
   void wait_for_any_gc_to_complete(Locker& locker, Process* process, Process::State new_state);
 
+  // Scavenges a suspended process taken from _gc_targets and resumes it.  The
+  // scheduler lock is released while the heap is scavenged.
+  void scavenge_target(Locker& locker, Process* target, bool on_idle_thread);
+
   typedef enum {
     ONLY_IF_PROCESSES_ARE_READY,
     EVEN_IF_PROCESSES_NOT_READY
@@ -167,6 +255,19 @@ class Scheduler {
   void process_ready(Process* process);
   void process_ready(Locker& locker, Process* process);
 
+  // Returns the scheduler thread we are running on, or null if called from
+  // another thread, e.g. an event source.
+  SchedulerThread* current_scheduler_thread(Locker& locker);
+
+  // Takes the next process to run on the given thread from its local queue,
+  // the global queue, or the queue of another thread, in that order.
+  Process* next_ready_process(Locker& locker, SchedulerThread* scheduler_thread);
+  void remove_ready_process(Locker& locker, Process* process);
+
+  // Wakes the given thread, or any idle thread if it is null or busy.
+  void wake_idle_thread(Locker& locker, SchedulerThread* preferred);
+  void wake_thread(Locker& locker, SchedulerThread* thread);
+
   bool has_exit_reason() { return _exit_state.reason != EXIT_NONE; }
 
   scheduler_err_t send_system_message(Locker& locker, SystemMessage* message);
@@ -177,20 +278,54 @@ class Scheduler {
 
   Scheduler::ExitState launch_program(Locker& locker, Process* process);
 
-  Process* find_process(Locker& locker, int process_id);
+  // Senders look up processes and deliver messages without the scheduler
+  // lock.  They do so inside a lookup scope, and processes are only deleted
+  // after all scopes that might have found them are left.  The scopes are
+  // counted per epoch, and [wait_for_lookups] starts a new epoch and waits
+  // for the scopes of the previous one.
+  class LookupScope {
+   public:
+    explicit LookupScope(Scheduler* scheduler);
+    ~LookupScope();
+
+   private:
+    Scheduler* const _scheduler;
+    uword _epoch;
+
+    // Leaves the count of the epoch, and wakes up [wait_for_lookups] if this
+    // was the last scope of an old epoch.
+    void leave();
+  };
+
+  // Must be called without holding the scheduler lock.
+  void wait_for_lookups();
+
+  scheduler_err_t deliver_message(Process* process, Message* message);
 
   // Called by the launch thread, to signal that time has passed.
-  // The tick is used to drive process preemption.
-  static const int64 TICK_PERIOD_US = 100000;  // 100 ms.
+  // The tick is used to drive process preemption, so it limits how
+  // precisely time slices are enforced.  The short tick is only needed while
+  // processes wait in the ready queues or are being profiled.  Otherwise the
+  // launch thread only wakes up for the watchdog, which saves power on
+  // devices.
+  static const int64 TICK_PERIOD_US = 10000;  // 10 ms.
+  static const int64 IDLE_TICK_PERIOD_US = 100000;  // 100 ms.
 #ifdef TOIT_FREERTOS
   static const int64 WATCHDOG_PERIOD_US = 10 * 1000 * 1000;  // 10 s.
 #else
   static const int64 WATCHDOG_PERIOD_US = 600 * 1000 * 1000;  // 10 m.
 #endif
-  void tick(Locker& locker);
+  // Returns whether the next tick should come after TICK_PERIOD_US rather
+  // than IDLE_TICK_PERIOD_US.
+  bool tick(Locker& locker);
+
+  int64 time_slice_us(Process* process);
+  void enqueue(ProcessListFromScheduler* queue, Process* process);
+  // Whether the ready process [a] should run before [b]: the one with the
+  // lower virtual runtime, or the one that became ready first.
+  static bool runs_before(Process* a, Process* b);
 
   Mutex* _mutex;
-  ConditionVariable* _has_processes;
   ConditionVariable* _has_threads;
   ExitState _exit_state;
 
@@ -203,15 +338,47 @@ class Scheduler {
   // Number of OS threads that we're waiting for to be preempted for GC.
   int _gc_waiting_for_preemption;
 
+  // Suspended processes that are waiting to be scavenged.  Idle scheduler
+  // threads help the thread that started the GC with these.
+  ProcessListFromScheduler _gc_targets;
+  // Number of processes taken from or still on _gc_targets that have not
+  // been scavenged yet.  Signals _gc_condition when it reaches zero.
+  int _gc_pending_scavenges;
+
+  // Stats for cross-process GCs.
+  int _gc_cross_process_count;
+  int _gc_cross_process_scavenges;
+  int _gc_idle_thread_scavenges;
+  int64 _gc_cross_process_total_us;
+  int64 _gc_cross_process_max_us;
+
   int _num_processes;
   int _next_group_id;
   int _next_process_id;
+  // Processes made ready outside the scheduler threads.  Each scheduler
+  // thread also has a local queue.
   ProcessListFromScheduler _ready_processes;
+  // Number of processes in all the queues.
+  int _num_ready_processes;
+  // Virtual runtime of the most recently started process.  Only grows.
+  int64 _min_vruntime;
 
   int _num_threads;
   int _max_threads;
+  int _num_idle_threads;
+  // Set when the launch thread must switch to the short tick before the
+  // current tick period is over.
+  bool _fast_tick_requested;
   SchedulerThreadList _threads;
 
+  ProcessTable _process_table;
+  std::atomic<uword> _lookup_epoch;
+  std::atomic<int> _lookups[2];
+  // Serializes the epoch changes in [wait_for_lookups].
+  Mutex* _reclaim_mutex;
+  // Signalled when the last scope of an old epoch is left.
+  ConditionVariable* _reclaim_condition;
+
   // Keep track of the boot process if it still alive.
   Process* _boot_process;
 
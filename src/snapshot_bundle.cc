@@ -20,6 +20,10 @@
 #include "snapshot_bundle.h"
 #include "compiler/ar.h"
 
+#ifdef TOIT_POSIX
+#include <sys/mman.h>
+#endif
+
 namespace toit {
 
 static const char* const MAGIC_NAME = "toit";
@@ -108,6 +112,16 @@ SnapshotBundle SnapshotBundle::read_from_file(const char* bundle_filename, bool
   fseek(file, 0, SEEK_END);
   long fsize = ftell(file);
   int size = fsize;
+#ifdef TOIT_POSIX
+  // Map the file instead of reading it. Pages are only read when they are
+  // touched, so the debug snapshot and the source maps usually stay on disk.
+  // The mapping is private, so writes to the buffer never reach the file.
+  void* mapping = mmap(null, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+  if (mapping != MAP_FAILED) {
+    fclose(file);
+    return SnapshotBundle(unvoid_cast<uint8*>(mapping), size, true);
+  }
+#endif
   // Read entire content.
   uint8* buffer = unvoid_cast<uint8*>(malloc(size));
   if (buffer == null) {
@@ -127,6 +141,18 @@ SnapshotBundle SnapshotBundle::read_from_file(const char* bundle_filename, bool
   return SnapshotBundle(buffer, size);
 }
 
+void SnapshotBundle::release() {
+#ifdef TOIT_POSIX
+  if (_is_mapped) {
+    munmap(_buffer, _size);
+    _buffer = null;
+    return;
+  }
+#endif
+  free(_buffer);
+  _buffer = null;
+}
+
 bool SnapshotBundle::write_to_file(const char* bundle_filename, bool silent) {
   FILE* file = fopen(bundle_filename, "wb");
   if (!file) {
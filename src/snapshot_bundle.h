@@ -27,8 +27,8 @@ namespace toit {
 
 class SnapshotBundle {
  public:
-  SnapshotBundle(uint8* buffer, int size)
-      : _buffer(buffer), _size(size) { }
+  SnapshotBundle(uint8* buffer, int size, bool is_mapped = false)
+      : _buffer(buffer), _size(size), _is_mapped(is_mapped) { }
 
   /// Returns a new SnapshotBundle, where the buffer is allocated with 'malloc'.
   /// The given data is not reused and can be freed.
@@ -40,10 +40,13 @@ class SnapshotBundle {
   static SnapshotBundle invalid() { return SnapshotBundle(null, 0); }
 
   /// Reads a snapshot bundle from the given [path].
-  /// If successful, allocates the buffer using `malloc` and returns
-  ///   a valid bundle.
+  /// If successful, returns a valid bundle. Where supported, the file is
+  ///   mapped into memory (private and copy-on-write), so that only the
+  ///   sections that are accessed (usually just the snapshot) are read from
+  ///   disk. Otherwise the buffer is allocated using `malloc`.
   /// Otherwise returns an invalid bundle. If [silent] is false,
   /// also writes an error message on stderr.
+  /// The bundle must be freed with [release].
   static SnapshotBundle read_from_file(const char* path, bool silent = false);
 
   /// Writes this bundle to the given [path].
@@ -54,6 +57,13 @@ class SnapshotBundle {
 
   bool is_valid() const { return _buffer != null; }
 
+  /// Whether the buffer is a memory mapping of the bundle file, rather than
+  ///   allocated with `malloc`.
+  bool is_mapped() const { return _is_mapped; }
+
+  /// Unmaps or frees the buffer.
+  void release();
+
   Snapshot snapshot();
 
   uint8* buffer() { return _buffer; }
@@ -68,6 +78,7 @@ class SnapshotBundle {
  private:
   uint8* _buffer;
   int _size;
+  bool _is_mapped;
 };
 
 } // namespace toit
@@ -75,6 +75,10 @@ enum StructTag {
   RawByteTag = 0,
   NullStructTag = 1,
   MappedFileTag = 2,
+  // Read-only views of a SharedBuffer.  The owner view is the one the memory
+  // is accounted to.
+  SharedBufferTag = 3,
+  SharedBufferOwnerTag = 4,
 
   // Resource subclasses.
   ResourceMinTag,
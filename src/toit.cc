@@ -93,7 +93,7 @@ static ProgramImage attempt_to_load_snapshot(char* bundle_path) {
   // Just ignore the wrapper if we are unable to load the file.
   if (!bundle.is_valid()) return ProgramImage::invalid();
   auto result = bundle.snapshot().read_image();
-  free(bundle.buffer());
+  bundle.release();
   return result;
 }
 
@@ -203,11 +203,9 @@ int main(int argc, char **argv) {
     auto bundle = SnapshotBundle::read_from_file(bundle_file);
     if (!bundle.is_valid()) print_usage(1);
     exit_state = run_program(boot_bundle_path, bundle, &argv[bundle_argv_index + 1]);
-    // The bundle is put in an external ByteArray and automatically freed when
-    // the heap is torn down.
-    // TODO(florian): it looks like we don't free the bundle. There is a copy
-    //   of the bundle in the byte-array (which is automatically freed), but the
-    //   initial memory isn't released.
+    // A mapped bundle is put in an external ByteArray that doesn't own the
+    // memory, so it stays valid across restarts and is unmapped here.
+    if (bundle.is_mapped()) bundle.release();
   } else if (strcmp(argv[1], "-i") == 0) {
     // Image writing.
     if (argc != 4) {
@@ -219,7 +217,7 @@ int main(int argc, char **argv) {
     auto bundle = SnapshotBundle::read_from_file(bundle_filename);
     if (!bundle.is_valid()) print_usage(1);
     write_image_from_bundle(image_filename, bundle);
-    free(bundle.buffer());
+    bundle.release();
   } else {
     char* bundle_filename = null;
 
@@ -448,7 +446,7 @@ int main(int argc, char **argv) {
         if (!compiled.write_to_file(bundle_filename)) {
           print_usage(1);
         }
-        free(compiled.buffer());
+        compiled.release();
       }
     }
   }
@@ -26,6 +26,10 @@
 #include "os.h"
 #include "snapshot.h"
 
+#ifdef TOIT_POSIX
+#include <sys/mman.h>
+#endif
+
 namespace toit {
 
 static void print_usage(int exit_code) {
@@ -96,15 +100,32 @@ int main(int argc, char **argv) {
 
   const int CHUNK_WORD_SIZE = WORD_BIT_SIZE + 1;
   int image_word_size = image_size / WORD_SIZE;
-  for (int i = 0; i < image_word_size; i += CHUNK_WORD_SIZE) {
-    word buffer[CHUNK_WORD_SIZE];
-    int end = std::min(i + CHUNK_WORD_SIZE, image_word_size);
-    int chunk_word_size = end - i;
-    int read_words = fread(buffer, WORD_SIZE, chunk_word_size, file);
-    if (chunk_word_size != read_words) {
-      FATAL("Problems reading the image");
+  bool is_relocated = false;
+#ifdef TOIT_POSIX
+  // Relocate directly from a mapping of the file, so that the image is only
+  // copied once.
+  void* mapping = mmap(null, image_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  if (mapping != MAP_FAILED) {
+    const word* image_words = reinterpret_cast<const word*>(mapping);
+    for (int i = 0; i < image_word_size; i += CHUNK_WORD_SIZE) {
+      int end = std::min(i + CHUNK_WORD_SIZE, image_word_size);
+      output.write(&image_words[i], end - i);
+    }
+    munmap(mapping, image_size);
+    is_relocated = true;
+  }
+#endif
+  if (!is_relocated) {
+    for (int i = 0; i < image_word_size; i += CHUNK_WORD_SIZE) {
+      word buffer[CHUNK_WORD_SIZE];
+      int end = std::min(i + CHUNK_WORD_SIZE, image_word_size);
+      int chunk_word_size = end - i;
+      int read_words = fread(buffer, WORD_SIZE, chunk_word_size, file);
+      if (chunk_word_size != read_words) {
+        FATAL("Problems reading the image");
+      }
+      output.write(reinterpret_cast<word*>(buffer), chunk_word_size);
     }
-    output.write(reinterpret_cast<word*>(buffer), chunk_word_size);
   }
   fclose(file);
   int exit_state = run_program(reinterpret_cast<Program*>(relocated.program()));
@@ -117,11 +117,14 @@ typedef intptr_t word;
 typedef uintptr_t uword;
 
 #if (__WORDSIZE == 64) || __WIN64
+typedef int half_word;
 typedef unsigned int uhalf_word;
 #else
+typedef short half_word;
 typedef unsigned short uhalf_word;
 #endif
 static_assert(sizeof(uhalf_word) == sizeof(uword) / 2, "Unexpected half-word size");
+static_assert(sizeof(half_word) == sizeof(uhalf_word), "Unexpected half-word size");
 
 typedef signed char int8;
 typedef short int16;
@@ -297,6 +300,7 @@ class SchedulerThread;
 class Semaphore;
 class SnapshotWriter;
 class SnapshotReader;
+class SharedBuffer;
 class SystemMessage;
 
 // Forward declaration to support be-friending
@@ -319,6 +323,8 @@ class LargeInteger;
 
 #ifdef PROFILER
 class Profiler;
+class SamplingProfiler;
+class AllocationProfiler;
 #endif
 
 // If you capture too many variables, then the functor does heap allocations.
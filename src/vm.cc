@@ -16,6 +16,7 @@
 #include <signal.h>
 
 #include "entropy_mixer.h"
+#include "flags.h"
 #include "memory.h"
 #include "objects_inline.h"
 #include "os.h"
@@ -50,6 +51,7 @@ VM::VM() {
 }
 
 VM::~VM() {
+  if (Flags::bytecode_sequences) Interpreter::print_bytecode_sequences();
   delete _event_manager;
   delete _scheduler;
   delete _heap_memory;